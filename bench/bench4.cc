@@ -0,0 +1,247 @@
+#include <nanobench.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <workspace/workspace.hpp>
+// https://nanobench.ankerl.com/reference.html
+
+using wsp::details::histogram;
+using wsp::details::now_ns;
+
+// latency of the tasks of one case (ns)
+struct latency {
+    std::string name;
+    histogram start;   // submit -> start
+    histogram finish;  // submit -> completion
+};
+
+// samples kept by each worker, so recording takes no lock
+struct recorder {
+    histogram start;
+    histogram finish;
+};
+
+std::vector<latency> results;
+
+void busy_for(uint64_t ns) {
+    auto until = now_ns() + ns;
+    while (now_ns() < until) {
+    }
+}
+
+// the task measured by every case
+struct probe {
+    uint64_t submitted;
+    uint64_t work_ns;
+
+    void operator()() const {
+        auto started = now_ns();
+        if (work_ns) busy_for(work_ns);
+        auto& r = wsp::this_worker().local<recorder>();
+        r.start.add(histogram::index_of(started - submitted), 1);
+        r.finish.add(histogram::index_of(now_ns() - submitted), 1);
+    }
+};
+
+// merge the samples of every worker into the results
+void collect(wsp::workbranch& br, const std::string& name) {
+    latency lat;
+    lat.name = name;
+    std::mutex lok;
+    br.broadcast([&] {
+          auto& r = wsp::this_worker().local<recorder>();
+          std::lock_guard<std::mutex> lock(lok);
+          lat.start.merge(r.start);
+          lat.finish.merge(r.finish);
+          r = recorder();
+      })
+        .wait();
+    results.push_back(lat);
+}
+
+// 1% of the tasks take 100us, 9% take 10us, the others are empty
+uint64_t mixed_work(size_t i) {
+    return i % 100 == 0 ? 100000 : i % 100 < 10 ? 10000 : 0;
+}
+
+void wait_all_done(wsp::workbranch& br) {
+    br.wait_idle(std::chrono::steady_clock::now() + std::chrono::minutes(1));
+}
+
+/**
+ * @brief threads started once per case, released by an epoch for each run
+ * @note So a run does not time creating and joining threads.
+ */
+class crew {
+    std::vector<std::thread> threads;
+    std::atomic<uint64_t> epoch{0};  // bumped to start a run, or to quit
+    std::atomic<bool> quit{false};
+    std::atomic<size_t> finished{0};  // threads done with this run
+
+public:
+    // job(i) runs on the ith thread in every run
+    template <typename F>
+    crew(size_t n, F job) {
+        for (size_t i = 0; i < n; ++i) {
+            threads.emplace_back([this, i, job] {
+                for (uint64_t seen = 0;; ++seen) {
+                    while (epoch.load(std::memory_order_acquire) == seen) std::this_thread::yield();
+                    if (quit.load(std::memory_order_acquire)) return;
+                    job(i);
+                    finished.fetch_add(1, std::memory_order_release);
+                }
+            });
+        }
+    }
+    ~crew() {
+        quit.store(true, std::memory_order_release);
+        epoch.fetch_add(1, std::memory_order_release);
+        for (auto& each : threads) each.join();
+    }
+    // release the threads and wait for them all
+    void run() {
+        finished.store(0, std::memory_order_relaxed);
+        epoch.fetch_add(1, std::memory_order_release);
+        while (finished.load(std::memory_order_acquire) < threads.size()) std::this_thread::yield();
+    }
+};
+
+// "producers" threads submit "tasks" tasks in total
+void producers_by_workers(ankerl::nanobench::Bench* bench, size_t producers, size_t workers, size_t tasks,
+                          bool mixed) {
+    wsp::workbranch br(workers, wsp::waitstrategy::lowlatancy);
+    auto name = std::to_string(producers) + " producers x " + std::to_string(workers) + " workers" +
+                (mixed ? ", mixed durations" : ", empty tasks");
+    {
+        crew submitters(producers, [&](size_t p) {
+            for (size_t i = p; i < tasks; i += producers) br.submit(probe{now_ns(), mixed ? mixed_work(i) : 0});
+        });
+        bench->run(name, [&] {
+            submitters.run();
+            wait_all_done(br);
+        });
+    }
+    collect(br, name);
+}
+
+// value-returning tasks, the producers wait for the futures
+void futures(ankerl::nanobench::Bench* bench, size_t producers, size_t workers, size_t tasks) {
+    wsp::workbranch br(workers, wsp::waitstrategy::lowlatancy);
+    auto name = std::to_string(producers) + " producers x " + std::to_string(workers) + " workers, futures";
+    {
+        crew submitters(producers, [&](size_t p) {
+            std::vector<std::future<int>> results;
+            results.reserve(tasks / producers + 1);
+            for (size_t i = p; i < tasks; i += producers) {
+                probe task{now_ns(), 0};
+                results.emplace_back(br.submit([task] {
+                    task();
+                    return 1;
+                }));
+            }
+            int sum = 0;
+            for (auto& each : results) sum += each.get();
+            ankerl::nanobench::doNotOptimizeAway(sum);
+        });
+        bench->run(name, [&] { submitters.run(); });
+    }
+    collect(br, name);
+}
+
+// urgent and normal probes submitted behind a backlog of normal tasks
+void urgent_under_backlog(ankerl::nanobench::Bench* bench, size_t workers, size_t backlog) {
+    wsp::workbranch urg(workers, wsp::waitstrategy::lowlatancy);
+    wsp::workbranch nor(workers, wsp::waitstrategy::lowlatancy);
+    auto suffix = " behind " + std::to_string(backlog) + " tasks";
+    auto filler = [] { busy_for(1000); };
+    bench->run("task::urg" + suffix, [&] {
+        for (size_t i = 0; i < backlog; ++i) urg.submit(filler);
+        for (int i = 0; i < 10; ++i) urg.submit<wsp::task::urg>(probe{now_ns(), 0});
+        wait_all_done(urg);
+    });
+    bench->run("task::nor" + suffix, [&] {
+        for (size_t i = 0; i < backlog; ++i) nor.submit(filler);
+        for (int i = 0; i < 10; ++i) nor.submit(probe{now_ns(), 0});
+        wait_all_done(nor);
+    });
+    collect(urg, "task::urg" + suffix);
+    collect(nor, "task::nor" + suffix);
+}
+
+// sparse submissions: how fast an idle worker starts a task under each wait strategy
+void wait_strategy(ankerl::nanobench::Bench* bench, wsp::waitstrategy strategy, const char* name) {
+    wsp::workbranch br(2, strategy);
+    bench->run(name, [&] {
+        for (int i = 0; i < 100; ++i) {
+            br.submit(probe{now_ns(), 0});
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        wait_all_done(br);
+    });
+    collect(br, name);
+}
+
+void write_latency(std::ostream& md, std::ostream& json, std::ostream& csv) {
+    const double ps[] = {50, 99, 99.9};
+    md << "\n| case | samples | start p50 (ns) | start p99 | start p99.9 | done p50 | done p99 | done p99.9 |\n";
+    md << "|:--|--:|--:|--:|--:|--:|--:|--:|\n";
+    csv << "case,samples,start_p50_ns,start_p99_ns,start_p999_ns,done_p50_ns,done_p99_ns,done_p999_ns\n";
+    json << "{\n  \"latency\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& r = results[i];
+        md << "| `" << r.name << "` | " << r.start.count();
+        csv << '"' << r.name << "\"," << r.start.count();
+        json << "    {\"case\": \"" << r.name << "\", \"samples\": " << r.start.count();
+        for (auto p : ps) {
+            md << " | " << r.start.percentile(p);
+            csv << ',' << r.start.percentile(p);
+        }
+        for (auto p : ps) {
+            md << " | " << r.finish.percentile(p);
+            csv << ',' << r.finish.percentile(p);
+        }
+        json << ", \"start_ns\": {\"p50\": " << r.start.percentile(50) << ", \"p99\": " << r.start.percentile(99)
+             << ", \"p99.9\": " << r.start.percentile(99.9) << "}";
+        json << ", \"done_ns\": {\"p50\": " << r.finish.percentile(50) << ", \"p99\": " << r.finish.percentile(99)
+             << ", \"p99.9\": " << r.finish.percentile(99.9) << "}}";
+        json << (i + 1 < results.size() ? ",\n" : "\n");
+        md << " |\n";
+        csv << '\n';
+    }
+    json << "  ]\n}\n";
+}
+
+int main(int argn, char** argvs) {
+    std::ofstream file("../bench4.md");
+
+    ankerl::nanobench::Bench b;
+    b.title("多生产者提交任务给workbranch执行（延迟分位数见表格下方）");
+    b.relative(false);  // the cases measure different things, no common baseline
+    b.output(&file);
+    b.timeUnit(std::chrono::milliseconds{1}, "ms");
+    b.epochs(5);
+
+    const size_t tasks = 20000;
+    for (size_t producers : {1, 2, 4}) {
+        for (size_t workers : {1, 2, 4}) producers_by_workers(&b, producers, workers, tasks, false);
+    }
+    producers_by_workers(&b, 4, 4, tasks, true);
+    futures(&b, 1, 4, tasks);
+    futures(&b, 4, 4, tasks);
+    urgent_under_backlog(&b, 2, 10000);
+    wait_strategy(&b, wsp::waitstrategy::lowlatancy, "waitstrategy::lowlatancy, sparse tasks");
+    wait_strategy(&b, wsp::waitstrategy::balance, "waitstrategy::balance, sparse tasks");
+    wait_strategy(&b, wsp::waitstrategy::blocking, "waitstrategy::blocking, sparse tasks");
+
+    std::ofstream json("../bench4.json"), csv("../bench4.csv");
+    std::ofstream latency_json("../bench4_latency.json"), latency_csv("../bench4_latency.csv");
+    ankerl::nanobench::render(ankerl::nanobench::templates::json(), b, json);
+    ankerl::nanobench::render(ankerl::nanobench::templates::csv(), b, csv);
+    write_latency(file, latency_json, latency_csv);
+}
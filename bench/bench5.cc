@@ -0,0 +1,173 @@
+#include <nanobench.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <workspace/workspace.hpp>
+// https://nanobench.ankerl.com/reference.html
+
+// Task queues driven directly by producer and consumer threads, without workers,
+// wake-ups or wait_tasks(), so queue backends can be compared on their own.
+
+using wsp::policy::task_t;
+using wsp::details::raw_task;
+
+enum class payload { empty, spilled, compact };
+
+const char* payload_name[] = {"empty task_t", "heap-spilled task_t", "raw_task"};
+
+// capture larger than the inline buffer of task_t
+struct big {
+    char pad[task_t::inline_size + 8];
+    void operator()() const {
+    }
+};
+
+void nothing(void*) {
+}
+
+template <typename Queue>
+void push(Queue& q, payload kind, bool front) {
+    switch (kind) {
+        case payload::empty:
+            front ? q.push_front(task_t([] {})) : q.push_back(task_t([] {}));
+            break;
+        case payload::spilled:
+            front ? q.push_front(task_t(big())) : q.push_back(task_t(big()));
+            break;
+        case payload::compact:
+            front ? q.push_front(raw_task{&nothing, nullptr}) : q.push_back(raw_task{&nothing, nullptr});
+            break;
+    }
+}
+
+// consumers' share of the pops: Jain's index, 1 means perfectly even
+struct fairness {
+    std::string name;
+    double index;
+    uint64_t min_pops;
+    uint64_t max_pops;
+};
+
+std::vector<fairness> results;
+
+/**
+ * @brief "producers" threads push "ops" tasks in total, "consumers" threads pop and run them
+ * @param front_percent share of push_front among the pushes (%)
+ * @note The threads are started before the measurement and released by an epoch for each run,
+ * so a run times the queue only, not creating and joining threads.
+ */
+template <template <typename> class Queue>
+void drive(ankerl::nanobench::Bench* bench, const char* queue, size_t producers, size_t consumers, payload kind,
+           unsigned front_percent, size_t ops) {
+    auto name = std::string(queue) + ", " + std::to_string(producers) + "P" + std::to_string(consumers) + "C, " +
+                payload_name[static_cast<int>(kind)] + ", front " + std::to_string(front_percent) + "%";
+    std::vector<uint64_t> pops(consumers, 0);
+    Queue<task_t> q;
+    std::atomic<uint64_t> epoch{0};  // bumped to start a run, or to quit
+    std::atomic<bool> quit{false};
+    std::atomic<size_t> left{0};      // tasks to pop in this run
+    std::atomic<size_t> finished{0};  // threads done with this run
+
+    // wait for the next run, false to quit
+    auto next = [&](uint64_t& seen) {
+        while (epoch.load(std::memory_order_acquire) == seen) std::this_thread::yield();
+        seen++;
+        return !quit.load(std::memory_order_acquire);
+    };
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p] {
+            for (uint64_t seen = 0; next(seen);) {
+                for (size_t i = p; i < ops; i += producers) push(q, kind, i % 100 < front_percent);
+                finished.fetch_add(1, std::memory_order_release);
+            }
+        });
+    }
+    for (size_t c = 0; c < consumers; ++c) {
+        threads.emplace_back([&, c] {
+            task_t task;
+            for (uint64_t seen = 0; next(seen);) {
+                uint64_t mine = 0;
+                while (left.load(std::memory_order_relaxed)) {
+                    if (q.try_pop(task)) {
+                        task();
+                        mine++;
+                        left.fetch_sub(1, std::memory_order_relaxed);
+                    } else {
+                        std::this_thread::yield();
+                    }
+                }
+                pops[c] += mine;
+                finished.fetch_add(1, std::memory_order_release);
+            }
+        });
+    }
+
+    bench->batch(ops).unit("op").run(name, [&] {
+        left.store(ops, std::memory_order_relaxed);
+        finished.store(0, std::memory_order_relaxed);
+        epoch.fetch_add(1, std::memory_order_release);
+        while (finished.load(std::memory_order_acquire) < threads.size()) std::this_thread::yield();
+    });
+    quit.store(true, std::memory_order_release);
+    epoch.fetch_add(1, std::memory_order_release);
+    for (auto& each : threads) each.join();
+
+    double sum = 0, squares = 0;
+    for (auto each : pops) {
+        sum += each;
+        squares += double(each) * each;
+    }
+    results.push_back({name, squares > 0 ? sum * sum / (consumers * squares) : 1,
+                       *std::min_element(pops.begin(), pops.end()), *std::max_element(pops.begin(), pops.end())});
+}
+
+template <template <typename> class Queue>
+void matrix(ankerl::nanobench::Bench* bench, const char* queue, const std::vector<size_t>& threads, size_t ops) {
+    for (auto kind : {payload::empty, payload::spilled, payload::compact}) {
+        for (unsigned front : {0u, 10u, 50u}) {
+            drive<Queue>(bench, queue, 1, 1, kind, front, ops);  // SPSC
+            for (auto n : threads) {
+                drive<Queue>(bench, queue, n, 1, kind, front, ops);  // MPSC
+                drive<Queue>(bench, queue, 1, n, kind, front, ops);  // SPMC
+                drive<Queue>(bench, queue, n, n, kind, front, ops);  // MPMC
+            }
+        }
+    }
+}
+
+int main(int argn, char** argvs) {
+    std::ofstream file("../bench5.md");
+
+    ankerl::nanobench::Bench b;
+    b.title("生产者与消费者线程直接读写任务队列（不经过worker）");
+    b.relative(false);
+    b.performanceCounters(true);
+    b.output(&file);
+    b.epochs(3);
+
+    // 2, 4 ... up to the number of cores (at most 16)
+    std::vector<size_t> threads;
+    auto cores = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 2u), 16);
+    for (size_t n = 2; n <= cores; n *= 2) threads.push_back(n);
+    if (threads.back() != cores) threads.push_back(cores);
+
+    const size_t ops = 100000;
+    matrix<wsp::policy::taskqueue>(&b, "taskqueue", threads, ops);
+    matrix<wsp::policy::fairqueue>(&b, "fairqueue", threads, ops);
+    matrix<wsp::policy::edfqueue>(&b, "edfqueue", threads, ops);
+
+    // pops of each consumer over all epochs
+    file << "\n| case | fairness (Jain) | min pops | max pops |\n|:--|--:|--:|--:|\n";
+    for (auto& each : results) {
+        file << "| `" << each.name << "` | " << each.index << " | " << each.min_pops << " | " << each.max_pops
+             << " |\n";
+    }
+    std::ofstream json("../bench5.json");
+    ankerl::nanobench::render(ankerl::nanobench::templates::json(), b, json);
+}
@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "timewait.h"
+#include "workspace/workspace.hpp"
+
+// Burst response of the supervisor.
+// An arrival trace is replayed against a supervised workbranch, either in real time
+// or against a simulated workbranch driven by a virtual clock (much faster than real time).
+
+using wsp::details::histogram;
+
+const uint64_t ms = 1000000;  // ns
+
+struct arrival {
+    uint64_t at;       // ns from the start
+    uint64_t service;  // ns
+};
+
+/**
+ * @brief generate an arrival trace
+ * @param kind poisson (constant rate), bursty (10x the rate for 10% of every fifth),
+ * diurnal (rate following a sine wave over the trace)
+ * @param rate mean arrivals per second of the base load
+ * @param service mean service time (ns, exponentially distributed)
+ */
+std::vector<arrival> make_trace(const std::string& kind, uint64_t duration, double rate, uint64_t service) {
+    std::mt19937_64 rng(42);
+    std::exponential_distribution<double> work(1.0 / service);
+    std::uniform_real_distribution<double> coin(0, 1);
+    auto rate_at = [&](double t) {
+        if (kind == "bursty") {
+            double phase = std::fmod(t, duration / 5.0) / (duration / 5.0);
+            return phase < 0.1 ? rate * 10 : rate;
+        }
+        if (kind == "diurnal") return rate * (1 + 0.9 * std::sin(2 * 3.14159265358979 * t / duration));
+        return rate;
+    };
+    double peak = kind == "bursty" ? rate * 10 : kind == "diurnal" ? rate * 1.9 : rate;
+    std::exponential_distribution<double> gap(peak / 1e9);
+
+    // non-homogeneous poisson process by thinning
+    std::vector<arrival> trace;
+    for (double t = gap(rng); t < duration; t += gap(rng)) {
+        if (coin(rng) * peak <= rate_at(t)) trace.push_back({uint64_t(t), uint64_t(work(rng)) + 1});
+    }
+    return trace;
+}
+
+// state of the workbranch seen at a tick
+struct sample {
+    uint64_t at;  // ns from the start
+    uint64_t workers;
+    uint64_t tasks;
+};
+
+struct report {
+    histogram wait;  // queue waiting time (ns)
+    std::vector<sample> timeline;
+    uint64_t adds = 0;  // add_worker() called by the supervisor
+    uint64_t dels = 0;  // del_worker() called by the supervisor
+    double wall = 0;    // s
+};
+
+/**
+ * @brief branch supervised in place of another one, counting the worker changes
+ * @note Counts every call, an add and a del between two ticks do not cancel out.
+ */
+class churn_counter : public wsp::details::branch_base {
+    wsp::details::branch_base& br;
+
+public:
+    std::atomic<uint64_t> adds{0};
+    std::atomic<uint64_t> dels{0};
+
+    explicit churn_counter(wsp::details::branch_base& b)
+      : br(b) {}
+    void add_worker() override {
+        adds++;
+        br.add_worker();
+    }
+    void del_worker() override {
+        dels++;
+        br.del_worker();
+    }
+    size_t num_workers() override {
+        return br.num_workers();
+    }
+    size_t num_tasks() override {
+        return br.num_tasks();
+    }
+    wsp::branch_snapshot snapshot() const override {
+        return br.snapshot();
+    }
+    void heartbeats(std::vector<uint64_t>& epochs) const override {
+        br.heartbeats(epochs);
+    }
+};
+
+/**
+ * @brief workbranch simulated by a virtual clock
+ * @note The workers take the queued tasks in FIFO order as soon as they are free,
+ * a new worker is ready after "spawn" ns, a deleted worker leaves after its current task.
+ */
+class sim_branch : public wsp::details::branch_base {
+    std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>> free_at;  // one per worker
+    std::deque<arrival> queue;
+    uint64_t now = 0;
+    uint64_t spawn = 0;
+    uint64_t nsubmit = 0;
+    uint64_t ndone = 0;
+
+public:
+    histogram wait;
+
+    sim_branch(size_t workers, uint64_t spawn_ns)
+      : spawn(spawn_ns) {
+        for (size_t i = 0; i < workers; ++i) free_at.push(0);
+    }
+    void add_worker() override {
+        free_at.push(now + spawn);
+    }
+    void del_worker() override {
+        if (!free_at.empty()) free_at.pop();
+    }
+    size_t num_workers() override {
+        return free_at.size();
+    }
+    size_t num_tasks() override {
+        return queue.size();
+    }
+    wsp::branch_snapshot snapshot() const override {
+        wsp::branch_snapshot snap;
+        snap.workers = free_at.size();
+        snap.tasks = queue.size();
+        snap.submitted = nsubmit;
+        snap.executed = ndone;
+        return snap;
+    }
+    void heartbeats(std::vector<uint64_t>& epochs) const override {
+        epochs.assign(free_at.size(), 0);
+    }
+
+    void submit(const arrival& a) {
+        queue.push_back(a);
+        nsubmit++;
+    }
+    // run the workers until "to"
+    void advance(uint64_t to) {
+        while (!queue.empty() && !free_at.empty()) {
+            auto start = std::max(free_at.top(), queue.front().at);
+            if (start > to) break;
+            free_at.pop();
+            free_at.push(start + queue.front().service);
+            wait.add(histogram::index_of(start - queue.front().at), 1);
+            queue.pop_front();
+            ndone++;
+        }
+        now = to;
+    }
+    bool idle() const {
+        return queue.empty();
+    }
+};
+
+report simulate(const std::vector<arrival>& trace, int wmin, int wmax, unsigned interval, uint64_t spawn) {
+    report r;
+    sim_branch br(std::max(wmin, 1), spawn);
+    churn_counter counted(br);
+    wsp::supervisor sp(wmin, wmax, wsp::manual_tick);  // checked by tick()
+    uint64_t now = 0;
+    sp.set_tick_cb([&](const std::vector<wsp::branch_snapshot>& snaps) {
+        r.timeline.push_back({now, snaps[0].workers, snaps[0].tasks});
+    });
+    sp.supervise(counted);
+    r.wall = timewait([&] {
+        size_t next = 0;
+        while (next < trace.size() || !br.idle()) {
+            now += interval * ms;
+            for (; next < trace.size() && trace[next].at <= now; ++next) br.submit(trace[next]);
+            br.advance(now);
+            sp.tick(now);
+        }
+    });
+    r.wait = br.wait;
+    r.adds = counted.adds;
+    r.dels = counted.dels;
+    return r;
+}
+
+report replay(const std::vector<arrival>& trace, int wmin, int wmax, unsigned interval) {
+    report r;
+    std::mutex lok;
+    wsp::workbranch br(std::max(wmin, 1), wsp::waitstrategy::blocking);
+    churn_counter counted(br);
+    auto begin = wsp::details::now_ns();
+    {
+        wsp::supervisor sp(wmin, wmax, interval);
+        sp.set_tick_cb([&](const std::vector<wsp::branch_snapshot>& snaps) {
+            if (snaps.empty()) return;  // ticked before supervising
+            std::lock_guard<std::mutex> lock(lok);
+            r.timeline.push_back({wsp::details::now_ns() - begin, snaps[0].workers, snaps[0].tasks});
+        });
+        sp.supervise(counted);
+        r.wall = timewait([&] {
+            auto start = std::chrono::steady_clock::now();
+            for (auto& a : trace) {
+                std::this_thread::sleep_until(start + std::chrono::nanoseconds(a.at));
+                auto submitted = wsp::details::now_ns();
+                br.submit([&, a, submitted] {
+                    auto waited = wsp::details::now_ns() - submitted;
+                    {
+                        std::lock_guard<std::mutex> lock(lok);
+                        r.wait.add(histogram::index_of(waited), 1);
+                    }
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(a.service));  // like I/O
+                });
+            }
+            br.wait_idle(std::chrono::steady_clock::now() + std::chrono::minutes(10));
+        });
+    }
+    r.adds = counted.adds;
+    r.dels = counted.dels;
+    return r;
+}
+
+void print_row(const std::string& trace, unsigned interval, const report& r, uint64_t duration) {
+    uint64_t peak_tasks = 0;
+    double workers = 0;
+    for (auto& s : r.timeline) {
+        peak_tasks = std::max(peak_tasks, s.tasks);
+        workers += s.workers;
+    }
+    if (!r.timeline.empty()) workers /= r.timeline.size();
+    std::cout << std::left << std::fixed << std::setprecision(2) << std::setw(8) << trace
+              << " | interval: " << std::setw(5) << interval << "| wait p50/p99/p99.9: " << std::setw(9)
+              << r.wait.percentile(50) / 1e6 << std::setw(9) << r.wait.percentile(99) / 1e6 << std::setw(9)
+              << r.wait.percentile(99.9) / 1e6 << "(ms) | peak queue: " << std::setw(7) << peak_tasks
+              << "| mean workers: " << std::setw(6) << workers << "| add/del: " << r.adds << "/" << r.dels
+              << " | speed: " << std::setprecision(0) << duration / 1e9 / r.wall << "x" << std::endl;
+}
+
+void print_timeline(const report& r, size_t rows = 20) {
+    size_t step = std::max<size_t>(1, r.timeline.size() / rows);
+    for (size_t i = 0; i < r.timeline.size(); i += step) {
+        auto& s = r.timeline[i];
+        std::cout << "  t: " << std::setw(10) << s.at / ms << "(ms) | workers: " << std::setw(3) << s.workers
+                  << "| tasks: " << s.tasks << std::endl;
+    }
+}
+
+int main(int argn, char** argvs) {
+    // usage: [sim|real] [poisson|bursty|diurnal] [min max interval_ms]
+    std::string mode = argn > 1 ? argvs[1] : "sim";
+    std::vector<std::string> traces = {"poisson", "bursty", "diurnal"};
+    if (argn > 2) traces = {argvs[2]};
+    int wmin = 1, wmax = 16;
+    std::vector<unsigned> intervals = {50, 200, 500, 1000};
+    if (argn == 6) {
+        wmin = atoi(argvs[3]);
+        wmax = atoi(argvs[4]);
+        intervals = {unsigned(atoi(argvs[5]))};
+    } else if (argn > 3 || (mode != "sim" && mode != "real")) {
+        fprintf(stderr, "Invalid parameter! usage: [sim|real] [poisson|bursty|diurnal] [min max interval_ms]\n");
+        return -1;
+    }
+
+    const uint64_t service = 2 * ms;  // 500 tasks/s per worker
+    const double rate = 1000;         // 2 busy workers on average
+    if (mode == "sim") {
+        const uint64_t duration = 3600000 * ms;  // one virtual hour
+        for (auto& kind : traces) {
+            auto trace = make_trace(kind, duration, rate, service);
+            for (auto interval : intervals) {
+                auto r = simulate(trace, wmin, wmax, interval, 100000);  // 100us to spawn a thread
+                print_row(kind, interval, r, duration);
+                if (intervals.size() == 1) print_timeline(r);
+            }
+        }
+    } else {
+        const uint64_t duration = 5000 * ms;
+        for (auto& kind : traces) {
+            auto trace = make_trace(kind, duration, rate, service);
+            for (auto interval : intervals) {
+                auto r = replay(trace, wmin, wmax, interval);
+                print_row(kind, interval, r, duration);
+                print_timeline(r);
+            }
+        }
+    }
+}
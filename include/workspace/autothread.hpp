@@ -1,5 +1,18 @@
 #pragma once
+#include <memory>
+#include <stdexcept>
 #include <thread>
+#include <type_traits>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#define WSP_HAS_PTHREAD 1
+#else
+#define WSP_HAS_PTHREAD 0
+#endif
 
 namespace wsp {
 namespace details {
@@ -51,5 +64,46 @@ public:
     }
 };
 
+/**
+ * @brief start a detached thread
+ * @param func thread function
+ * @param stack_size stack size in bytes (0: system default)
+ * @note The stack size is ignored where pthread is not available.
+ */
+template <typename F>
+void spawn_detached(F&& func, size_t stack_size = 0) {
+#if WSP_HAS_PTHREAD
+    if (stack_size) {
+        using D = typename std::decay<F>::type;
+        struct starter {
+            static void* run(void* arg) {
+                std::unique_ptr<D> fn(static_cast<D*>(arg));
+                (*fn)();
+                return nullptr;
+            }
+        };
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t least = static_cast<size_t>(PTHREAD_STACK_MIN);
+        if (stack_size < least) stack_size = least;
+        stack_size = (stack_size + page - 1) / page * page;
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        pthread_attr_setstacksize(&attr, stack_size);
+        auto fn = new D(std::forward<F>(func));
+        pthread_t tid;
+        int err = pthread_create(&tid, &attr, &starter::run, fn);
+        pthread_attr_destroy(&attr);
+        if (err) {
+            delete fn;
+            throw std::runtime_error("workspace: Failed to create a worker thread");
+        }
+        return;
+    }
+#endif
+    std::thread(std::forward<F>(func)).detach();
+}
+
 }  // namespace details
 }  // namespace wsp
\ No newline at end of file
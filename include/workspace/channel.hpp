@@ -0,0 +1,381 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <workspace/policy.hpp>
+#include <workspace/utility.hpp>
+
+namespace wsp {
+namespace details {
+
+/**
+ * @brief Bounded lock-free MPMC ring of values
+ * @tparam T value type (movable)
+ */
+template <typename T>
+class value_ring {
+    struct cell {
+        std::atomic<size_t> seq;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type data;
+
+        T* get() {
+            return reinterpret_cast<T*>(&data);
+        }
+    };
+
+    const size_t mask;
+    std::unique_ptr<cell[]> cells;
+    alignas(cacheline_size) std::atomic<size_t> tail{0};
+    alignas(cacheline_size) std::atomic<size_t> head{0};
+
+    static size_t round_up(size_t n) {
+        size_t cap = 2;
+        while (cap < n) cap <<= 1;
+        return cap;
+    }
+
+public:
+    explicit value_ring(size_t capacity)
+      : mask(round_up(capacity) - 1)
+      , cells(new cell[mask + 1]) {
+        for (size_t i = 0; i <= mask; ++i) cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+    value_ring(const value_ring&) = delete;
+    ~value_ring() {
+        T tmp;
+        while (pop(tmp)) {
+        }
+    }
+
+    template <typename U>
+    bool push(U&& v) {
+        auto pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            auto& c = cells[pos & mask];
+            auto seq = c.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    new (c.get()) T(std::forward<U>(v));
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // full
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(T& v) {
+        auto pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            auto& c = cells[pos & mask];
+            auto seq = c.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    v = std::move(*c.get());
+                    c.get()->~T();
+                    c.seq.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // empty
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // approximate while others are pushing or popping
+    size_t size() const {
+        auto h = head.load(std::memory_order_acquire);
+        auto t = tail.load(std::memory_order_acquire);
+        return t > h ? t - h : 0;
+    }
+    size_t capacity() const {
+        return mask + 1;
+    }
+};
+
+/**
+ * @brief Bounded MPMC channel between tasks
+ * @tparam T value type (default-constructible and movable)
+ * @note A channel is a handle, copies share the same queue. Sending to a full channel
+ * fails (try_send) or waits (send), which gives backpressure to the producers.
+ * A subscribed channel schedules a consumer task onto a workbranch when values arrive,
+ * so no worker blocks on receiving.
+ */
+template <typename T>
+class channel {
+    using items_cb = std::function<void(std::vector<T>&)>;
+    using close_cb = std::function<void()>;
+
+    // over-aligned (the ring), so allocated by cache_aligned::operator new
+    struct state : cache_aligned {
+        value_ring<T> ring;
+        std::atomic<bool> closed{false};
+        std::atomic<size_t> sending{0};  // senders between the closed check and the push
+        waiter senders;    // blocked in send()
+        waiter receivers;  // blocked in recv()
+
+        // subscriber, set once before use
+        std::function<void(task_t)> submit;
+        items_cb on_items;
+        close_cb on_close;
+        size_t batch = 0;
+        std::atomic<bool> scheduled{false};
+        std::atomic<bool> eos_sent{false};
+
+        explicit state(size_t capacity)
+          : ring(capacity) {
+        }
+    };
+
+    std::shared_ptr<state> st;
+
+public:
+    /**
+     * @brief construct a channel
+     * @param capacity max values held (rounded up to a power of 2)
+     */
+    explicit channel(size_t capacity = 1024)
+      : st(new state(capacity)) {
+    }
+
+    /**
+     * @brief send a value without waiting
+     * @param v value
+     * @return false if the channel is full or closed
+     */
+    template <typename U>
+    bool try_send(U&& v) {
+        if (!enter(*st)) return false;
+        bool sent = st->ring.push(std::forward<U>(v));
+        if (sent) arrived(*st);
+        leave(*st);
+        return sent;
+    }
+
+    /**
+     * @brief send values without waiting
+     * @param first begin of the values (moved from)
+     * @param last end of the values
+     * @return number of values sent (stops at the first one that does not fit)
+     */
+    template <typename Iter>
+    size_t try_send(Iter first, Iter last) {
+        if (!enter(*st)) return 0;
+        size_t n = 0;
+        for (; first != last && st->ring.push(std::move(*first)); ++first) ++n;
+        if (n) arrived(*st);
+        leave(*st);
+        return n;
+    }
+
+    /**
+     * @brief send a value, wait while the channel is full
+     * @param v value
+     * @return false if the channel is closed
+     * @note Do not call it in a worker of the branch that consumes the channel.
+     */
+    template <typename U>
+    bool send(U&& v) {
+        auto& s = *st;
+        while (enter(s)) {
+            if (s.ring.push(std::forward<U>(v))) {
+                arrived(s);
+                leave(s);
+                return true;
+            }
+            leave(s);  // not counted while waiting
+            s.senders.wait([&s] { return s.ring.size() < s.ring.capacity() || s.closed.load(); });
+        }
+        return false;
+    }
+
+    /**
+     * @brief receive a value without waiting
+     * @param v where the value goes
+     * @return false if the channel is empty
+     */
+    bool try_recv(T& v) {
+        if (!st->ring.pop(v)) return false;
+        st->senders.notify_all();
+        return true;
+    }
+
+    /**
+     * @brief receive values without waiting
+     * @param out where the values go (appended)
+     * @param max max number of values to receive
+     * @return number of values received
+     */
+    size_t try_recv(std::vector<T>& out, size_t max) {
+        return take(*st, out, max);
+    }
+
+    /**
+     * @brief receive a value, wait while the channel is empty
+     * @param v where the value goes
+     * @return false if the channel is closed and empty (end of stream)
+     */
+    bool recv(T& v) {
+        auto& s = *st;
+        while (true) {
+            if (s.ring.pop(v)) {
+                s.senders.notify_all();
+                return true;
+            }
+            if (ended(s)) {
+                if (s.ring.pop(v)) {  // sent before closing
+                    s.senders.notify_all();
+                    return true;
+                }
+                return false;
+            }
+            s.receivers.wait([&s] { return s.ring.size() > 0 || (s.closed.load() && !s.sending.load()); });
+        }
+    }
+
+    /**
+     * @brief close the channel, no value can be sent after it
+     * @note Values already sent can still be received, then receivers see the end of stream.
+     * A send racing close() either fails or delivers its value before the end of stream.
+     */
+    void close() {
+        auto& s = *st;
+        s.closed.store(true);
+        s.senders.notify_all();
+        s.receivers.notify_all();
+        schedule(st);
+    }
+
+    bool closed() const {
+        return st->closed.load(std::memory_order_acquire);
+    }
+    // number of values in the channel (approximate)
+    size_t size() const {
+        return st->ring.size();
+    }
+    size_t capacity() const {
+        return st->ring.capacity();
+    }
+
+    /**
+     * @brief consume the channel by tasks of a workbranch
+     * @param br workbranch running the consumer
+     * @param on_items called with up to "batch" values each time (in order, never concurrently)
+     * @param on_close called once after the channel is closed and drained
+     * @param batch max values of each call
+     * @note Subscribe once, before sending. The consumer task is only scheduled
+     * when values arrive and yields the worker after a few batches.
+     */
+    template <typename Branch>
+    void subscribe(Branch& br, items_cb on_items, close_cb on_close = nullptr, size_t batch = 64) {
+        auto& s = *st;
+        if (s.submit) throw std::runtime_error("workspace: Channel already has a subscriber");
+        s.on_items = std::move(on_items);
+        s.on_close = std::move(on_close);
+        s.batch = batch ? batch : 1;
+        s.submit = [&br](task_t task) { br.submit(std::move(task)); };
+        schedule(st);
+    }
+
+private:
+    static constexpr int batches_per_task = 16;
+
+    // count a sender in, false if the channel is closed
+    bool enter(state& s) {
+        s.sending.fetch_add(1);
+        if (!s.closed.load()) return true;
+        leave(s);  // a consumer may have seen this sender and be waiting for it
+        return false;
+    }
+    // the last sender out after close() lets the consumers see the end of stream
+    void leave(state& s) {
+        if (s.sending.fetch_sub(1) == 1 && s.closed.load()) {
+            s.receivers.notify_all();
+            schedule(st);
+        }
+    }
+    // closed and no value will arrive any more (seq_cst, in this order)
+    static bool ended(state& s) {
+        return s.closed.load() && !s.sending.load();
+    }
+
+    void arrived(state& s) {
+        s.receivers.notify_all();
+        if (s.submit) schedule(st);
+    }
+
+    static size_t take(state& s, std::vector<T>& out, size_t max) {
+        size_t n = 0;
+        T v;
+        while (n < max && s.ring.pop(v)) {
+            out.emplace_back(std::move(v));
+            ++n;
+        }
+        if (n) s.senders.notify_all();
+        return n;
+    }
+
+    // make sure a consumer task is queued or running
+    static void schedule(const std::shared_ptr<state>& sp) {
+        auto& s = *sp;
+        if (!s.submit) return;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (s.scheduled.load(std::memory_order_relaxed) || s.scheduled.exchange(true)) return;
+        if (!s.ring.size() && !s.closed.load()) {
+            s.scheduled.store(false);
+            if (!s.ring.size()) return;
+            if (s.scheduled.exchange(true)) return;
+        }
+        std::shared_ptr<state> keep = sp;
+        s.submit([keep] { consume(keep); });
+    }
+
+    static void consume(const std::shared_ptr<state>& sp) {
+        auto& s = *sp;
+        std::vector<T> items;
+        items.reserve(s.batch);
+        try {
+            for (int i = 0; i < batches_per_task; ++i) {
+                items.clear();
+                if (!take(s, items, s.batch)) break;
+                s.on_items(items);
+            }
+        } catch (...) {  // the values of this batch are lost, keep consuming the rest
+            release(sp);
+            throw;
+        }
+        if (s.ring.size()) {  // yield the worker to other tasks
+            auto keep = sp;
+            s.submit([keep] { consume(keep); });
+            return;
+        }
+        if (ended(s) && !s.ring.size()) {
+            if (!s.eos_sent.exchange(true) && s.on_close) s.on_close();
+            return;  // stays scheduled: nothing will arrive any more
+        }
+        release(sp);
+    }
+
+    static void release(const std::shared_ptr<state>& sp) {
+        auto& s = *sp;
+        s.scheduled.store(false);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (s.ring.size() || ended(s)) schedule(sp);
+    }
+};
+
+}  // namespace details
+}  // namespace wsp
@@ -0,0 +1,208 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <workspace/metrics.hpp>
+
+namespace wsp {
+namespace details {
+
+/**
+ * @brief Packs consecutive tasks of each producer thread into batches
+ * @tparam Task runnable object
+ * @note Every producer thread owns a batch, so appending only takes an uncontended lock.
+ * The batch of an exited thread is taken over by the next new producer, so the batches
+ * never outnumber the producers alive at once.
+ * A batch is published when it is full, when its first task is older than the window
+ * (checked by the next append and by sweep()), or by flush(). due_in() tells the idle
+ * workers how long they may park.
+ */
+template <typename Task>
+class coalescer {
+    struct batch {
+        std::mutex lok;
+        std::vector<Task> tasks;
+        uint64_t since = 0;  // time of the first task
+        batch* next = nullptr;
+        std::atomic<bool> owned{true};  // a live thread appends to it
+        std::atomic<int> refs{2};       // the list and the owner thread
+    };
+
+    static void unref(batch* b) {
+        if (b->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete b;
+    }
+
+    std::atomic<batch*> batches{nullptr};  // append-only list
+    std::atomic<size_t> max_size{0};
+    std::atomic<uint64_t> window_ns{0};
+    std::atomic<size_t> pending{0};  // non-empty batches
+    const uint64_t id = next_id();
+    std::shared_ptr<char> alive = std::make_shared<char>(0);  // expires with this coalescer
+
+    // batch of one coalescer kept by the producer thread
+    struct owned_batch {
+        uint64_t id;
+        std::weak_ptr<char> alive;
+        batch* b;
+    };
+    // batches of a producer thread, given back when it exits
+    struct owned_batches {
+        std::vector<owned_batch> list;
+        ~owned_batches() {
+            for (auto& each : list) {
+                each.b->owned.store(false, std::memory_order_release);
+                unref(each.b);
+            }
+        }
+    };
+
+    static uint64_t next_id() {
+        static std::atomic<uint64_t> ids{0};
+        return ids.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+public:
+    coalescer() = default;
+    coalescer(const coalescer&) = delete;
+    ~coalescer() {
+        alive.reset();
+        auto b = batches.load(std::memory_order_relaxed);
+        while (b) {
+            auto next = b->next;
+            unref(b);  // the owner thread may still hold it
+            b = next;
+        }
+    }
+
+    /**
+     * @brief set the limits of a batch
+     * @param size max tasks of a batch (0 or 1 disables coalescing)
+     * @param window_us max time (microseconds) a batch may wait for more tasks
+     */
+    void configure(size_t size, unsigned window_us) {
+        window_ns.store(uint64_t(window_us) * 1000, std::memory_order_relaxed);
+        max_size.store(size, std::memory_order_relaxed);
+    }
+
+    bool enabled() const {
+        return max_size.load(std::memory_order_relaxed) > 1;
+    }
+    // some batches are not published yet
+    bool holding() const {
+        return pending.load(std::memory_order_acquire) > 0;
+    }
+
+    /**
+     * @brief append a task to the batch of this thread
+     * @param publish takes std::vector<Task>&&
+     * @return true if the task started a batch that is held
+     */
+    template <typename P>
+    bool add(Task&& task, P&& publish) {
+        auto& b = this_batch();
+        std::lock_guard<std::mutex> lock(b.lok);
+        auto now = now_ns();
+        bool started = b.tasks.empty();
+        if (started) {
+            b.since = now;
+            pending.fetch_add(1, std::memory_order_relaxed);
+        }
+        b.tasks.emplace_back(std::move(task));
+        if (b.tasks.size() >= max_size.load(std::memory_order_relaxed) ||
+            now - b.since >= window_ns.load(std::memory_order_relaxed)) {
+            take(b, publish);
+            return false;
+        }
+        return started;
+    }
+
+    // publish the batches older than the window (lock-free when nothing is pending)
+    template <typename P>
+    void sweep(P&& publish) {
+        if (!pending.load(std::memory_order_relaxed)) return;
+        auto now = now_ns();
+        auto window = window_ns.load(std::memory_order_relaxed);
+        for (auto b = batches.load(std::memory_order_acquire); b; b = b->next) {
+            std::unique_lock<std::mutex> lock(b->lok, std::try_to_lock);
+            if (lock && !b->tasks.empty() && now - b->since >= window) take(*b, publish);
+        }
+    }
+
+    // ns until the oldest held batch is due (the window if unknown)
+    uint64_t due_in() {
+        auto now = now_ns();
+        auto window = window_ns.load(std::memory_order_relaxed);
+        auto left = window;
+        for (auto b = batches.load(std::memory_order_acquire); b; b = b->next) {
+            std::unique_lock<std::mutex> lock(b->lok, std::try_to_lock);
+            if (lock && !b->tasks.empty()) {
+                auto age = now - b->since;
+                left = std::min(left, age >= window ? 0 : window - age);
+            }
+        }
+        return left;
+    }
+
+    // number of batches (at most the producer threads alive at once)
+    size_t size() const {
+        size_t n = 0;
+        for (auto b = batches.load(std::memory_order_acquire); b; b = b->next) ++n;
+        return n;
+    }
+
+    // publish all batches
+    template <typename P>
+    void flush(P&& publish) {
+        if (!pending.load(std::memory_order_relaxed)) return;
+        for (auto b = batches.load(std::memory_order_acquire); b; b = b->next) {
+            std::lock_guard<std::mutex> lock(b->lok);
+            if (!b->tasks.empty()) take(*b, publish);
+        }
+    }
+
+private:
+    template <typename P>
+    void take(batch& b, P& publish) {
+        std::vector<Task> full;
+        full.reserve(max_size.load(std::memory_order_relaxed));
+        full.swap(b.tasks);
+        pending.fetch_sub(1, std::memory_order_relaxed);
+        publish(std::move(full));
+    }
+
+    // batch of this thread, taken over from an exited thread or created on first use
+    batch& this_batch() {
+        static thread_local owned_batches owned;
+        for (auto& each : owned.list) {
+            if (each.id == id) return *each.b;
+        }
+        // forget the batches of dead coalescers before adding one
+        auto dead = std::partition(owned.list.begin(), owned.list.end(),
+                                   [](const owned_batch& each) { return !each.alive.expired(); });
+        for (auto it = dead; it != owned.list.end(); ++it) unref(it->b);
+        owned.list.erase(dead, owned.list.end());
+
+        for (auto b = batches.load(std::memory_order_acquire); b; b = b->next) {
+            bool vacant = false;
+            if (!b->owned.load(std::memory_order_relaxed) &&
+                b->owned.compare_exchange_strong(vacant, true, std::memory_order_acquire)) {
+                b->refs.fetch_add(1, std::memory_order_relaxed);
+                owned.list.push_back(owned_batch{id, alive, b});
+                return *b;  // its tasks, if any, stay in order
+            }
+        }
+        auto b = new batch;
+        b->next = batches.load(std::memory_order_relaxed);
+        while (!batches.compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+        owned.list.push_back(owned_batch{id, alive, b});
+        return *b;
+    }
+};
+
+}  // namespace details
+}  // namespace wsp
@@ -0,0 +1,216 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace wsp {
+namespace details {
+
+/**
+ * @brief Bump allocator rewound after each task
+ * @note Memory is never freed one by one. After a task that needed several chunks,
+ * they are merged into one so the next task does not allocate again.
+ */
+class scratch_arena {
+    static constexpr size_t first_size = 4096;
+
+    struct chunk {
+        chunk* prev;
+        size_t size;  // bytes of data
+        size_t used;
+    };
+    chunk* cur = nullptr;
+    bool dirty = false;
+
+    static unsigned char* data(chunk* c) {
+        return reinterpret_cast<unsigned char*>(c + 1);
+    }
+
+    static chunk* make_chunk(size_t size, chunk* prev) {
+        auto c = static_cast<chunk*>(std::malloc(sizeof(chunk) + size));
+        if (!c) throw std::bad_alloc();
+        c->prev = prev;
+        c->size = size;
+        c->used = 0;
+        return c;
+    }
+
+public:
+    scratch_arena() = default;
+    scratch_arena(const scratch_arena&) = delete;
+    ~scratch_arena() {
+        release();
+    }
+
+    /**
+     * @brief allocate memory valid until current task ends
+     * @param n bytes
+     * @param align alignment (power of 2)
+     * @return pointer to the memory
+     */
+    void* allocate(size_t n, size_t align = alignof(std::max_align_t)) {
+        dirty = true;
+        if (cur) {
+            auto base = reinterpret_cast<uintptr_t>(data(cur));
+            auto at = (base + cur->used + align - 1) & ~uintptr_t(align - 1);
+            if (at + n <= base + cur->size) {
+                cur->used = at + n - base;
+                return reinterpret_cast<void*>(at);
+            }
+        }
+        size_t size = cur ? cur->size * 2 : first_size;
+        while (size < n + align) size *= 2;
+        cur = make_chunk(size, cur);
+        auto base = reinterpret_cast<uintptr_t>(data(cur));
+        auto at = (base + align - 1) & ~uintptr_t(align - 1);
+        cur->used = at + n - base;
+        return reinterpret_cast<void*>(at);
+    }
+
+    // allocate an uninitialized array of trivial objects
+    template <typename T>
+    T* allocate_array(size_t n) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena never runs destructors");
+        return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+    }
+
+    // rewind (called after each task)
+    void reset() {
+        if (!dirty) return;
+        dirty = false;
+        if (cur->prev) {
+            size_t total = 0;
+            for (auto c = cur; c; c = c->prev) total += c->size;
+            release();
+            cur = make_chunk(total, nullptr);
+        } else {
+            cur->used = 0;
+        }
+    }
+
+    // bytes kept for the next tasks
+    size_t capacity() const {
+        size_t total = 0;
+        for (auto c = cur; c; c = c->prev) total += c->size;
+        return total;
+    }
+
+private:
+    void release() {
+        while (cur) {
+            auto prev = cur->prev;
+            std::free(cur);
+            cur = prev;
+        }
+    }
+};
+
+/**
+ * @brief State owned by the worker running current task
+ * @note Got by wsp::this_worker() inside a task. Everything is cleared when the worker
+ * leaves, a worker added later may reuse the index with a fresh context.
+ */
+class worker_context {
+    struct holder_base {
+        virtual ~holder_base() = default;
+    };
+    template <typename T>
+    struct holder : holder_base {
+        T value;
+        template <typename... Args>
+        holder(Args&&... args)
+          : value(std::forward<Args>(args)...) {
+        }
+    };
+
+    size_t idx = 0;
+    scratch_arena scratch;
+    std::vector<std::unique_ptr<holder_base>> locals;  // by type id
+
+    static size_t next_type_id() {
+        static std::atomic<size_t> ids{0};
+        return ids.fetch_add(1, std::memory_order_relaxed);
+    }
+    template <typename T>
+    static size_t type_id() {
+        static const size_t id = next_type_id();
+        return id;
+    }
+
+public:
+    worker_context() = default;
+    worker_context(const worker_context&) = delete;
+
+    /**
+     * @brief index of the worker in its workbranch
+     * @return index in [0, num_workers()) while no worker is leaving
+     */
+    size_t index() const {
+        return idx;
+    }
+
+    /**
+     * @brief scratch memory rewound after current task
+     * @return reference of the arena
+     */
+    scratch_arena& arena() {
+        return scratch;
+    }
+
+    /**
+     * @brief get the object of type T owned by this worker
+     * @return reference of the object (default-constructed by the first call)
+     */
+    template <typename T>
+    T& local() {
+        if (auto p = find<T>()) return *p;
+        return attach<T>();
+    }
+
+    /**
+     * @brief attach an object of type T to this worker (replaces the old one)
+     * @param args arguments to construct T
+     * @return reference of the object
+     */
+    template <typename T, typename... Args>
+    T& attach(Args&&... args) {
+        auto id = type_id<T>();
+        if (locals.size() <= id) locals.resize(id + 1);
+        auto h = new holder<T>(std::forward<Args>(args)...);
+        locals[id].reset(h);
+        return h->value;
+    }
+
+    /**
+     * @brief find the object of type T attached to this worker
+     * @return pointer to the object or nullptr
+     */
+    template <typename T>
+    T* find() {
+        auto id = type_id<T>();
+        if (id >= locals.size() || !locals[id]) return nullptr;
+        return &static_cast<holder<T>*>(locals[id].get())->value;
+    }
+
+    // called by the workbranch
+    void enter(size_t index) {
+        idx = index;
+    }
+    void after_task() {
+        scratch.reset();
+    }
+    // called outside the lock of the workbranch: destructors of the objects are user code
+    void leave() {
+        locals.clear();
+        scratch.reset();
+    }
+};
+
+}  // namespace details
+}  // namespace wsp
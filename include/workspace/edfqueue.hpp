@@ -0,0 +1,201 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <workspace/metrics.hpp>
+#include <workspace/utility.hpp>
+
+namespace wsp {
+namespace details {
+
+// counters of an edfqueue
+struct deadline_stats {
+    uint64_t misses = 0;   // tasks started after their deadline
+    uint64_t dropped = 0;  // expired tasks discarded instead of run
+    uint64_t steals = 0;   // tasks taken from the shard of another thread
+};
+
+/**
+ * @brief A thread-safe task queue ordered by deadline
+ * @tparam T runnable object
+ * @note Tasks are kept in several heaps (shards), each thread pushes into its own shard.
+ * A pop reads the earliest deadline of every shard without locking and takes the task
+ * from the earliest one, so the order is earliest-deadline-first across shards except
+ * for tasks pushed at the same time. Untagged tasks are due after the default deadline,
+ * urgent tasks are due at once and, like push_front elsewhere, the latest runs first
+ * (among the ones pushed by the same thread).
+ */
+template <typename T>
+class edfqueue {
+    struct entry {
+        uint64_t deadline;
+        uint64_t seq;  // FIFO among equal deadlines, decreasing for urgent tasks (LIFO)
+        T task;
+    };
+    struct later {
+        bool operator()(const entry& a, const entry& b) const {
+            return a.deadline != b.deadline ? a.deadline > b.deadline : a.seq > b.seq;
+        }
+    };
+    struct shard : cache_aligned {
+        alignas(cacheline_size) std::mutex lok;
+        std::vector<entry> heap;
+        uint64_t seq = 0;
+        std::atomic<uint64_t> top{UINT64_MAX};  // earliest deadline, readable without the lock
+    };
+
+    static constexpr uint64_t urgent_deadline = 0;
+
+    std::vector<std::unique_ptr<shard>> shards;
+    std::atomic<size_t> count{0};
+    std::atomic<uint64_t> default_ns{1000000000};  // 1s
+    std::atomic<bool> drop{false};
+
+    std::atomic<uint64_t> nback{0};
+    std::atomic<uint64_t> nfront{0};
+    std::atomic<uint64_t> npop{0};
+    std::atomic<uint64_t> nmiss{0};
+    std::atomic<uint64_t> ndrop{0};
+    std::atomic<uint64_t> nsteal{0};
+
+    static void incr(std::atomic<uint64_t>& counter) {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+public:
+    using size_type = size_t;
+    edfqueue() {
+        auto n = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), 16);
+        for (size_t i = 0; i < n; ++i) shards.emplace_back(new shard);
+    }
+    edfqueue(const edfqueue&) = delete;
+
+public:
+    /**
+     * @brief push a task due at the deadline
+     * @param deadline steady clock time (ns, see now_ns())
+     */
+    template <typename U>
+    void push_by(uint64_t deadline, U&& v) {
+        push(deadline, std::forward<U>(v));
+        incr(nback);
+    }
+    // deadline of untagged tasks, relative to their submission
+    void set_default_deadline(uint64_t ns) {
+        default_ns.store(ns, std::memory_order_relaxed);
+    }
+    // discard the tasks popped after their deadline
+    void set_drop_expired(bool on) {
+        drop.store(on, std::memory_order_relaxed);
+    }
+    deadline_stats deadlines() const {
+        deadline_stats st;
+        st.misses = nmiss.load(std::memory_order_relaxed);
+        st.dropped = ndrop.load(std::memory_order_relaxed);
+        st.steals = nsteal.load(std::memory_order_relaxed);
+        return st;
+    }
+
+    void push_back(T& v) {
+        push_by(now_ns() + default_ns.load(std::memory_order_relaxed), v);
+    }
+    void push_back(T&& v) {
+        push_by(now_ns() + default_ns.load(std::memory_order_relaxed), std::move(v));
+    }
+    void push_back(const raw_task& v) {
+        push_by(now_ns() + default_ns.load(std::memory_order_relaxed), v);
+    }
+    void push_front(T& v) {
+        push(urgent_deadline, v);
+        incr(nfront);
+    }
+    void push_front(T&& v) {
+        push(urgent_deadline, std::move(v));
+        incr(nfront);
+    }
+    void push_front(const raw_task& v) {
+        push(urgent_deadline, v);
+        incr(nfront);
+    }
+    bool try_pop(T& tmp) {
+        while (count.load(std::memory_order_acquire)) {
+            size_t best = shards.size();
+            uint64_t earliest = UINT64_MAX;
+            for (size_t i = 0; i < shards.size(); ++i) {
+                auto d = shards[i]->top.load(std::memory_order_acquire);
+                if (d < earliest) {
+                    earliest = d;
+                    best = i;
+                }
+            }
+            if (best == shards.size()) return false;  // being pushed
+            uint64_t deadline;
+            {
+                auto& s = *shards[best];
+                std::lock_guard<std::mutex> lock(s.lok);
+                if (s.heap.empty()) continue;  // taken by another worker
+                std::pop_heap(s.heap.begin(), s.heap.end(), later());
+                deadline = s.heap.back().deadline;
+                tmp = std::move(s.heap.back().task);
+                s.heap.pop_back();
+                s.top.store(s.heap.empty() ? UINT64_MAX : s.heap.front().deadline, std::memory_order_release);
+            }
+            incr(npop);
+            count.fetch_sub(1, std::memory_order_release);
+            if (best != home()) incr(nsteal);
+            if (deadline != urgent_deadline && deadline < now_ns()) {
+                if (drop.load(std::memory_order_relaxed)) {
+                    incr(ndrop);
+                    tmp = T();
+                    continue;
+                }
+                incr(nmiss);
+            }
+            return true;
+        }
+        return false;
+    }
+    size_type length() {
+        return count.load(std::memory_order_acquire);
+    }
+    // number of tasks pushed back (lock-free)
+    uint64_t pushed_back() const {
+        return nback.load(std::memory_order_relaxed);
+    }
+    // number of tasks pushed front (lock-free)
+    uint64_t pushed_front() const {
+        return nfront.load(std::memory_order_relaxed);
+    }
+    // number of tasks popped or dropped (lock-free)
+    uint64_t popped() const {
+        return npop.load(std::memory_order_relaxed);
+    }
+
+private:
+    template <typename U>
+    void push(uint64_t deadline, U&& v) {
+        auto& s = *shards[home()];
+        {
+            std::lock_guard<std::mutex> lock(s.lok);
+            auto seq = s.seq++;
+            s.heap.push_back(entry{deadline, deadline == urgent_deadline ? ~seq : seq, T(std::forward<U>(v))});
+            std::push_heap(s.heap.begin(), s.heap.end(), later());
+            s.top.store(s.heap.front().deadline, std::memory_order_release);
+        }
+        count.fetch_add(1, std::memory_order_release);
+    }
+
+    // shard of this thread
+    size_t home() const {
+        static std::atomic<size_t> threads{0};
+        static thread_local size_t id = threads.fetch_add(1, std::memory_order_relaxed);
+        return id % shards.size();
+    }
+};
+
+}  // namespace details
+}  // namespace wsp
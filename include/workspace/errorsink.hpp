@@ -0,0 +1,207 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <typeinfo>
+#include <workspace/utility.hpp>
+
+namespace wsp {
+namespace details {
+
+// An exception caught by a worker
+struct error_info {
+    std::thread::id thread;  // thread that caught it
+    uint64_t timestamp = 0;  // system clock (ns since epoch)
+    char type[64] = {};      // implementation-defined type name ("unknown" for non-std exceptions)
+    char what[192] = {};     // message (truncated)
+};
+
+/**
+ * @brief Bounded lock-free MPMC ring of error_info
+ * @note Pushing into a full ring fails instead of blocking.
+ */
+class error_ring : public cache_aligned {
+    struct cell {
+        std::atomic<size_t> seq;
+        error_info info;
+    };
+    static constexpr size_t capacity = 128;  // power of 2
+
+    cell cells[capacity];
+    alignas(cacheline_size) std::atomic<size_t> tail{0};
+    alignas(cacheline_size) std::atomic<size_t> head{0};
+
+public:
+    error_ring() {
+        for (size_t i = 0; i < capacity; ++i) cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+    error_ring(const error_ring&) = delete;
+
+    bool push(const error_info& info) {
+        auto pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            auto& c = cells[pos & (capacity - 1)];
+            auto seq = c.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    c.info = info;
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // full
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(error_info& info) {
+        auto pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            auto& c = cells[pos & (capacity - 1)];
+            auto seq = c.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    info = c.info;
+                    c.seq.store(pos + capacity, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // empty
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+/**
+ * @brief Where workers report the exceptions they caught
+ * @note By default errors are recorded in a lock-free ring and kept for drain(), the workers
+ * never write to std::cerr, so a failure storm never serializes them on the iostream lock.
+ * The errors nobody drained are printed when the sink is destroyed. A custom handler
+ * replaces the ring entirely.
+ */
+class error_sink {
+public:
+    using handler_t = std::function<void(const error_info&)>;
+
+private:
+    handler_t handler = {};
+    std::atomic<error_ring*> ring{nullptr};  // allocated by the first error
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> lost{0};
+    const char* source = "worker";
+
+public:
+    explicit error_sink(const char* who = "worker")
+      : source(who) {
+    }
+    error_sink(const error_sink&) = delete;
+    ~error_sink() {
+        print_rest();
+        if (auto n = lost.load()) {
+            std::cerr << "workspace: " << n << " error(s) dropped\n" << std::flush;
+        }
+        delete ring.load();
+    }
+
+    /**
+     * @brief replace the default ring by a handler (called on the worker thread)
+     * @param cb handler, an empty one restores the default ring
+     * @note Set it before submitting tasks.
+     */
+    void set_handler(handler_t cb) {
+        handler = std::move(cb);
+    }
+
+    void report(const std::exception& ex) {
+        error_info info;
+        fill(info, typeid(ex).name(), ex.what());
+        report(info);
+    }
+    void report_unknown() {
+        error_info info;
+        fill(info, "unknown", "");
+        report(info);
+    }
+
+    /**
+     * @brief take the recorded errors out of the ring
+     * @param deal how to deal with each error
+     * @param max max number of errors to take
+     * @return number of errors taken
+     */
+    size_t drain(const handler_t& deal, size_t max = size_t(-1)) {
+        auto r = ring.load(std::memory_order_acquire);
+        if (!r) return 0;
+        size_t n = 0;
+        error_info info;
+        while (n < max && r->pop(info)) {
+            deal(info);
+            ++n;
+        }
+        return n;
+    }
+
+    // number of errors reported
+    uint64_t count() const {
+        return total.load(std::memory_order_relaxed);
+    }
+    // number of errors dropped since the ring was full
+    uint64_t dropped() const {
+        return lost.load(std::memory_order_relaxed);
+    }
+
+private:
+    static void fill(error_info& info, const char* type, const char* what) {
+        info.thread = std::this_thread::get_id();
+        info.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+        std::strncpy(info.type, type, sizeof(info.type) - 1);
+        std::strncpy(info.what, what, sizeof(info.what) - 1);
+    }
+
+    void report(const error_info& info) {
+        total.fetch_add(1, std::memory_order_relaxed);
+        if (handler) {
+            handler(info);
+            return;
+        }
+        auto r = ring.load(std::memory_order_acquire);
+        if (!r) {
+            auto fresh = new error_ring;
+            if (ring.compare_exchange_strong(r, fresh, std::memory_order_acq_rel)) {
+                r = fresh;
+            } else {
+                delete fresh;
+            }
+        }
+        if (!r->push(info)) lost.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // print the errors nobody drained
+    void print_rest() {
+        drain([this](const error_info& info) {
+            if (!std::strcmp(info.type, "unknown")) {
+                std::cerr << "workspace: " << source << "[" << info.thread << "] caught unknown exception\n";
+            } else {
+                std::cerr << "workspace: " << source << "[" << info.thread << "] caught exception:\n  what(): "
+                          << info.what << '\n';
+            }
+        });
+        std::cerr << std::flush;
+    }
+};
+
+}  // namespace details
+}  // namespace wsp
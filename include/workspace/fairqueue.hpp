@@ -0,0 +1,212 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <workspace/utility.hpp>
+
+namespace wsp {
+namespace details {
+
+// counters of one tenant of a fairqueue
+struct tenant_stats {
+    unsigned weight = 1;
+    size_t max_depth = 0;  // 0: unlimited
+    size_t depth = 0;      // tasks queued now
+    uint64_t submitted = 0;
+    uint64_t executed = 0;  // popped by workers
+    uint64_t rejected = 0;  // over max_depth
+};
+
+/**
+ * @brief A thread-safe task queue shared fairly by tenants
+ * @tparam T runnable object
+ * @note Every tenant has its own sub-queue. Workers take tasks by deficit round robin:
+ * a tenant gets "weight" tasks per round, so a tenant flooding the queue only delays
+ * itself. Urgent tasks bypass the tenants. Untagged tasks belong to tenant 0.
+ * Picking the next task is O(1).
+ */
+template <typename T>
+class fairqueue {
+    struct tenant {
+        std::deque<T> q;
+        tenant_stats stats;
+        unsigned deficit = 0;  // tasks left in this round
+        bool active = false;   // in the round
+        tenant* next = nullptr;
+    };
+
+    std::mutex tq_lok;
+    std::unordered_map<uint32_t, std::unique_ptr<tenant>> tenants;
+    std::deque<T> urgent;
+    tenant* head = nullptr;  // round of the tenants having tasks
+    tenant* tail = nullptr;
+    size_t count = 0;
+
+    std::atomic<uint64_t> nback{0};
+    std::atomic<uint64_t> nfront{0};
+    std::atomic<uint64_t> npop{0};
+
+    static void incr(std::atomic<uint64_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+public:
+    using size_type = size_t;
+    fairqueue() = default;
+    fairqueue(const fairqueue&) = delete;
+
+public:
+    /**
+     * @brief set the share and the queue limit of a tenant
+     * @param id tenant id
+     * @param weight tasks taken from the tenant per round (at least 1)
+     * @param max_depth max tasks queued by the tenant (0: unlimited)
+     */
+    void set_tenant(uint32_t id, unsigned weight, size_t max_depth = 0) {
+        std::lock_guard<std::mutex> lock(tq_lok);
+        auto& t = get(id);
+        t.stats.weight = weight ? weight : 1;
+        t.stats.max_depth = max_depth;
+    }
+    /**
+     * @brief get the counters of a tenant
+     * @param id tenant id
+     * @return tenant_stats (default values if the tenant never submitted)
+     */
+    tenant_stats stats_of(uint32_t id) {
+        std::lock_guard<std::mutex> lock(tq_lok);
+        auto it = tenants.find(id);
+        return it == tenants.end() ? tenant_stats() : it->second->stats;
+    }
+
+    /**
+     * @brief push a task of a tenant
+     * @return false if the tenant has max_depth tasks queued
+     */
+    template <typename U>
+    bool push_back_as(uint32_t id, U&& v) {
+        std::lock_guard<std::mutex> lock(tq_lok);
+        auto& t = get(id);
+        if (t.stats.max_depth && t.q.size() >= t.stats.max_depth) {
+            t.stats.rejected++;
+            return false;
+        }
+        t.q.emplace_back(std::forward<U>(v));
+        t.stats.depth = t.q.size();
+        t.stats.submitted++;
+        if (!t.active) join(t);
+        count++;
+        incr(nback);
+        return true;
+    }
+
+    void push_back(T& v) {
+        push_unlimited(T(v));
+    }
+    void push_back(T&& v) {
+        push_unlimited(std::move(v));
+    }
+    void push_back(const raw_task& v) {
+        push_unlimited(T(v));
+    }
+    void push_front(T& v) {
+        std::lock_guard<std::mutex> lock(tq_lok);
+        urgent.emplace_front(v);
+        count++;
+        incr(nfront);
+    }
+    void push_front(T&& v) {
+        std::lock_guard<std::mutex> lock(tq_lok);
+        urgent.emplace_front(std::move(v));
+        count++;
+        incr(nfront);
+    }
+    void push_front(const raw_task& v) {
+        std::lock_guard<std::mutex> lock(tq_lok);
+        urgent.emplace_front(v);
+        count++;
+        incr(nfront);
+    }
+    bool try_pop(T& tmp) {
+        std::lock_guard<std::mutex> lock(tq_lok);
+        if (!urgent.empty()) {
+            tmp = std::move(urgent.front());
+            urgent.pop_front();
+        } else if (head) {
+            auto& t = *head;
+            if (!t.deficit) t.deficit = t.stats.weight;  // its turn starts
+            tmp = std::move(t.q.front());
+            t.q.pop_front();
+            t.stats.depth = t.q.size();
+            t.stats.executed++;
+            if (t.q.empty()) {  // leaves the round
+                head = t.next;
+                if (!head) tail = nullptr;
+                t.next = nullptr;
+                t.active = false;
+                t.deficit = 0;
+            } else if (!--t.deficit && head != tail) {  // turn used up, go to the end
+                head = t.next;
+                t.next = nullptr;
+                tail->next = &t;
+                tail = &t;
+            }
+        } else {
+            return false;
+        }
+        count--;
+        incr(npop);
+        return true;
+    }
+    size_type length() {
+        std::lock_guard<std::mutex> lock(tq_lok);
+        return count;
+    }
+    // number of tasks pushed back (lock-free)
+    uint64_t pushed_back() const {
+        return nback.load(std::memory_order_relaxed);
+    }
+    // number of tasks pushed front (lock-free)
+    uint64_t pushed_front() const {
+        return nfront.load(std::memory_order_relaxed);
+    }
+    // number of tasks popped (lock-free)
+    uint64_t popped() const {
+        return npop.load(std::memory_order_relaxed);
+    }
+
+private:
+    // untagged tasks (tenant 0) are never rejected
+    void push_unlimited(T&& v) {
+        std::lock_guard<std::mutex> lock(tq_lok);
+        auto& t = get(0);
+        t.q.emplace_back(std::move(v));
+        t.stats.depth = t.q.size();
+        t.stats.submitted++;
+        if (!t.active) join(t);
+        count++;
+        incr(nback);
+    }
+
+    tenant& get(uint32_t id) {
+        auto& p = tenants[id];
+        if (!p) p.reset(new tenant);
+        return *p;
+    }
+
+    void join(tenant& t) {
+        t.active = true;
+        if (tail) {
+            tail->next = &t;
+        } else {
+            head = &t;
+        }
+        tail = &t;
+    }
+};
+
+}  // namespace details
+}  // namespace wsp
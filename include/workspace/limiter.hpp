@@ -0,0 +1,199 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <workspace/autothread.hpp>
+#include <workspace/metrics.hpp>
+#include <workspace/utility.hpp>
+
+namespace wsp {
+namespace details {
+
+/**
+ * @brief Rate limit and concurrency cap in front of a workbranch
+ * @note Tasks over the limits are held here instead of in the task queue, so they occupy
+ * no worker. A task is handed to the workbranch when a token of the bucket is available
+ * and fewer than max_running tasks of this limiter are running. A timer thread hands
+ * the held tasks over when the bucket refills. Use one limiter per tag to limit the
+ * tasks of a workbranch separately.
+ */
+class limiter {
+    using submit_fn = std::function<void(task_t)>;
+
+    // task handed to the workbranch, releases its running slot when it ends (even by an exception)
+    struct limited_task {
+        limiter* self;
+        task_t task;
+
+        struct guard {
+            limiter* self;
+            ~guard() {
+                self->finished();
+            }
+        };
+        void operator()() {
+            guard g{self};
+            task();
+        }
+    };
+
+private:
+    submit_fn submit_to;
+    std::mutex lok;
+    std::condition_variable timer_cv;
+    std::condition_variable idle_cv;
+    std::deque<task_t> held;
+    double rate = 0;   // tokens per second, 0: unlimited
+    double burst = 1;  // bucket size
+    double tokens = 1;
+    uint64_t refilled_at = 0;  // ns
+    size_t max_running = 0;    // 0: unlimited
+    size_t running = 0;
+    uint64_t nheld = 0;  // tasks that had to wait
+    bool stop = false;
+
+    autothread<join> timer;  // declared last: started after and joined before the members above
+
+public:
+    /**
+     * @brief construct a limiter
+     * @param br workbranch running the tasks
+     * @param tasks_per_sec rate of the token bucket (0: unlimited)
+     * @param burst_size tasks that may start at once after being idle (at least 1)
+     * @param max_concurrency max tasks of this limiter running at the same time (0: unlimited)
+     */
+    template <typename Branch>
+    limiter(Branch& br, double tasks_per_sec, double burst_size = 1, size_t max_concurrency = 0)
+      : submit_to([&br](task_t task) { br.submit(std::move(task)); })
+      , rate(tasks_per_sec > 0 ? tasks_per_sec : 0)
+      , burst(burst_size >= 1 ? burst_size : 1)
+      , tokens(burst)
+      , refilled_at(now_ns())
+      , max_running(max_concurrency)
+      , timer(std::thread(&limiter::mission, this)) {
+    }
+    limiter(const limiter&) = delete;
+    /**
+     * @brief wait for the held and running tasks, then stop the timer
+     */
+    ~limiter() {
+        std::unique_lock<std::mutex> lock(lok);
+        idle_cv.wait(lock, [this] { return held.empty() && !running; });
+        stop = true;
+        timer_cv.notify_one();
+    }
+
+    /**
+     * @brief run the task within the limits
+     * @param task runnable object returning void
+     */
+    template <typename F>
+    void submit(F&& task) {
+        std::lock_guard<std::mutex> lock(lok);
+        held.emplace_back(std::forward<F>(task));
+        if (held.size() > 1 || !dispatch()) nheld++;
+    }
+
+    /**
+     * @brief change the token bucket
+     * @param tasks_per_sec rate (0: unlimited)
+     * @param burst_size bucket size (at least 1)
+     */
+    void set_rate(double tasks_per_sec, double burst_size = 1) {
+        std::lock_guard<std::mutex> lock(lok);
+        refill(now_ns());
+        rate = tasks_per_sec > 0 ? tasks_per_sec : 0;
+        burst = burst_size >= 1 ? burst_size : 1;
+        if (tokens > burst) tokens = burst;
+        dispatch();
+    }
+    /**
+     * @brief change the concurrency cap
+     * @param max_concurrency max running tasks (0: unlimited)
+     */
+    void set_concurrency(size_t max_concurrency) {
+        std::lock_guard<std::mutex> lock(lok);
+        max_running = max_concurrency;
+        dispatch();
+    }
+
+    // number of tasks held by the limits
+    size_t num_held() {
+        std::lock_guard<std::mutex> lock(lok);
+        return held.size();
+    }
+    // number of tasks handed to the workbranch and not finished
+    size_t num_running() {
+        std::lock_guard<std::mutex> lock(lok);
+        return running;
+    }
+    // number of tasks that could not start at once
+    uint64_t num_delayed() {
+        std::lock_guard<std::mutex> lock(lok);
+        return nheld;
+    }
+
+private:
+    void refill(uint64_t now) {
+        if (rate > 0 && now > refilled_at) {
+            tokens += (now - refilled_at) * rate / 1e9;
+            if (tokens > burst) tokens = burst;
+        }
+        refilled_at = now;
+    }
+
+    // under "lok": hand over the held tasks the limits allow, false if some are left
+    bool dispatch() {
+        auto now = now_ns();
+        refill(now);
+        while (!held.empty()) {
+            if (max_running && running >= max_running) return false;  // released by finished()
+            if (rate > 0) {
+                if (tokens < 1) {
+                    timer_cv.notify_one();
+                    return false;
+                }
+                tokens -= 1;
+            }
+            running++;
+            limited_task next{this, std::move(held.front())};
+            held.pop_front();
+            try {
+                submit_to(std::move(next));
+            } catch (...) {
+                running--;
+                throw;
+            }
+        }
+        return true;
+    }
+
+    void finished() {
+        std::lock_guard<std::mutex> lock(lok);
+        running--;
+        dispatch();
+        if (held.empty() && !running) idle_cv.notify_all();
+    }
+
+    // refill the bucket for the held tasks
+    void mission() {
+        std::unique_lock<std::mutex> lock(lok);
+        while (!stop) {
+            if (held.empty() || rate <= 0 || tokens >= 1) {
+                timer_cv.wait(lock);
+            } else {
+                auto wait_ns = static_cast<int64_t>((1 - tokens) / rate * 1e9) + 1;
+                timer_cv.wait_for(lock, std::chrono::nanoseconds(wait_ns));
+            }
+            if (!held.empty()) dispatch();
+        }
+    }
+};
+
+}  // namespace details
+}  // namespace wsp
@@ -0,0 +1,258 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <stdexcept>
+#include <workspace/context.hpp>
+#include <workspace/taskqueue.hpp>
+#include <workspace/trace.hpp>
+#include <workspace/utility.hpp>
+
+namespace wsp {
+namespace details {
+
+// monotonic clock in nanoseconds
+inline uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// CPU time of this thread in nanoseconds (0 where not supported)
+inline uint64_t thread_cpu_ns() {
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) return 0;
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+// CPU time of this process in nanoseconds (0 where not supported)
+inline uint64_t process_cpu_ns() {
+#if defined(CLOCK_PROCESS_CPUTIME_ID)
+    timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts)) return 0;
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+// single-writer increment: a plain load and store instead of a locked RMW
+inline void bump(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Aggregated counters of a workbranch
+ * @note Counters are monotonic, subtract two snapshots to get rates.
+ */
+struct branch_snapshot {
+    uint64_t workers = 0;     // current workers
+    uint64_t declining = 0;   // part of "workers" asked to leave, such as busy on a task
+    uint64_t tasks = 0;       // tasks waiting in the task queue
+    uint64_t submitted = 0;   // tasks pushed into the task queue
+    uint64_t urgent = 0;      // part of "submitted" pushed as urgent tasks
+    uint64_t executed = 0;    // tasks done by the workers
+    uint64_t exceptions = 0;  // exceptions caught by the workers
+    uint64_t spins = 0;       // idle loops of busy-waiting
+    uint64_t parks = 0;       // times of sleeping or blocking while idle
+    uint64_t busy_ns = 0;     // time spent in executing tasks (ns)
+    uint64_t busy_cpu_ns = 0;      // CPU time of the workers while executing tasks (ns)
+    uint64_t busy_sampled_ns = 0;  // part of busy_ns that busy_cpu_ns covers (ns)
+    uint64_t idle_cpu_ns = 0;      // CPU time of the workers while idle, such as spinning (ns)
+};
+
+/**
+ * @brief Counters owned by one worker
+ * @note Only the owner writes them (relaxed), anyone may read them at any time.
+ */
+struct alignas(cacheline_size) worker_stats {
+    std::atomic<uint64_t> executed{0};
+    std::atomic<uint64_t> exceptions{0};
+    std::atomic<uint64_t> spins{0};
+    std::atomic<uint64_t> parks{0};
+    std::atomic<uint64_t> busy_ns{0};
+    std::atomic<uint64_t> busy_since{0};  // 0: idle
+    std::atomic<uint64_t> epoch{0};       // heartbeat: +1 when a task starts and ends, odd while running
+    std::atomic<uint64_t> busy_cpu_ns{0};
+    std::atomic<uint64_t> idle_cpu_ns{0};
+    std::atomic<uint64_t> settled{0};  // tasks from the task queue or the mailbox finished
+    uint64_t cpu_mark = 0;  // thread CPU time of the last switch (owner only)
+
+    // clocks are read only when switching between busy and idle
+    void begin_busy() {
+        if (!busy_since.load(std::memory_order_relaxed)) {
+            busy_since.store(now_ns(), std::memory_order_relaxed);
+            auto cpu = thread_cpu_ns();
+            if (cpu_mark && cpu > cpu_mark) bump(idle_cpu_ns, cpu - cpu_mark);
+            cpu_mark = cpu;
+        }
+    }
+    // true if a busy period was closed
+    bool end_busy() {
+        auto since = busy_since.load(std::memory_order_relaxed);
+        if (!since) return false;
+        bump(busy_ns, now_ns() - since);
+        busy_since.store(0, std::memory_order_relaxed);
+        auto cpu = thread_cpu_ns();
+        if (cpu_mark && cpu > cpu_mark) bump(busy_cpu_ns, cpu - cpu_mark);
+        cpu_mark = cpu;
+        return true;
+    }
+    // account the busy period so far without ending it (for workers that never get idle)
+    void sample_busy() {
+        auto since = busy_since.load(std::memory_order_relaxed);
+        if (since) {
+            auto now = now_ns();
+            bump(busy_ns, now - since);
+            busy_since.store(now, std::memory_order_relaxed);
+            auto cpu = thread_cpu_ns();
+            if (cpu_mark && cpu > cpu_mark) bump(busy_cpu_ns, cpu - cpu_mark);
+            cpu_mark = cpu;
+        }
+    }
+    // a task from the task queue or the mailbox finished (published for quiescence checks)
+    void settle() {
+        settled.store(settled.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    // called by a new owner thread
+    void start() {
+        cpu_mark = thread_cpu_ns();
+    }
+    // add to the snapshot, including the busy period in progress
+    void collect(branch_snapshot& snap, uint64_t now) const {
+        snap.executed += executed.load(std::memory_order_relaxed);
+        snap.exceptions += exceptions.load(std::memory_order_relaxed);
+        snap.spins += spins.load(std::memory_order_relaxed);
+        snap.parks += parks.load(std::memory_order_relaxed);
+        auto busy = busy_ns.load(std::memory_order_relaxed);
+        snap.busy_ns += busy;
+        snap.busy_sampled_ns += busy;
+        snap.busy_cpu_ns += busy_cpu_ns.load(std::memory_order_relaxed);
+        snap.idle_cpu_ns += idle_cpu_ns.load(std::memory_order_relaxed);
+        auto since = busy_since.load(std::memory_order_relaxed);
+        if (since && now > since) snap.busy_ns += now - since;
+    }
+};
+
+// Per-worker state, reused by the next worker after its owner leaves
+struct worker_slot {
+    worker_stats stats;
+    mailbox mail;  // tasks for this worker only
+    worker_context context;
+#if WSP_ENABLE_TRACE
+    worker_trace trace;
+#endif
+    size_t index = 0;
+    std::atomic<bool> in_use{false};
+};
+
+/**
+ * @brief Append-only list of worker slots
+ * @note acquire()/release() are serialized by the owner's lock,
+ * for_each() is lock-free and can be called concurrently.
+ */
+class worker_slots {
+    static constexpr size_t block_size = 8;
+
+    struct block : cache_aligned {
+        worker_slot slots[block_size];
+        std::atomic<block*> next{nullptr};
+    };
+
+    block* head = new block;
+    size_t capacity = block_size;
+
+public:
+    worker_slots() {
+        for (size_t i = 0; i < block_size; ++i) head->slots[i].index = i;
+    }
+    worker_slots(const worker_slots&) = delete;
+    ~worker_slots() {
+        auto blk = head;
+        while (blk) {
+            auto next = blk->next.load(std::memory_order_relaxed);
+            delete blk;
+            blk = next;
+        }
+    }
+
+    // get the free slot with the smallest index
+    worker_slot* acquire() {
+        block* blk = head;
+        block* last = nullptr;
+        while (blk) {
+            for (auto& slot : blk->slots) {
+                if (!slot.in_use.load(std::memory_order_relaxed)) {
+                    slot.in_use.store(true, std::memory_order_relaxed);
+                    return &slot;
+                }
+            }
+            last = blk;
+            blk = blk->next.load(std::memory_order_relaxed);
+        }
+        blk = new block;
+        for (size_t i = 0; i < block_size; ++i) blk->slots[i].index = capacity + i;
+        capacity += block_size;
+        blk->slots[0].in_use.store(true, std::memory_order_relaxed);
+        last->next.store(blk, std::memory_order_release);
+        return &blk->slots[0];
+    }
+
+    // get the slot by index (nullptr if it was never created)
+    worker_slot* at(size_t index) {
+        block* blk = head;
+        while (blk && index >= block_size) {
+            blk = blk->next.load(std::memory_order_acquire);
+            index -= block_size;
+        }
+        return blk ? &blk->slots[index] : nullptr;
+    }
+
+    void release(worker_slot* slot) {
+        slot->in_use.store(false, std::memory_order_relaxed);
+    }
+
+    // visit every slot ever used (counters of the leaving workers are kept)
+    template <typename F>
+    void for_each(F&& deal) const {
+        const block* blk = head;
+        while (blk) {
+            for (auto& slot : blk->slots) deal(slot);
+            blk = blk->next.load(std::memory_order_acquire);
+        }
+    }
+    template <typename F>
+    void for_each(F&& deal) {
+        block* blk = head;
+        while (blk) {
+            for (auto& slot : blk->slots) deal(slot);
+            blk = blk->next.load(std::memory_order_acquire);
+        }
+    }
+};
+
+// slot of the worker running on this thread (nullptr for other threads)
+inline worker_slot*& this_slot() {
+    static thread_local worker_slot* slot = nullptr;
+    return slot;
+}
+
+// context of the worker running on this thread
+inline worker_context& this_worker() {
+    auto slot = this_slot();
+    if (!slot) throw std::runtime_error("workspace: this_worker() called outside a worker");
+    return slot->context;
+}
+
+// count the exception caught by current worker
+inline void count_exception() {
+    if (auto slot = this_slot()) bump(slot->stats.exceptions);
+}
+
+}  // namespace details
+}  // namespace wsp
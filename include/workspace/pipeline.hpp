@@ -0,0 +1,279 @@
+#pragma once
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <workspace/utility.hpp>
+
+namespace wsp {
+namespace details {
+
+/**
+ * @brief Linear pipeline of stages bound to workbranches
+ * @tparam T item carried by a token (default-constructible, processed in place)
+ * @note At most max_tokens items are in flight. A token is carried from stage to stage by
+ * the same task while the next stage is bound to the same workbranch, it only goes
+ * through a task queue when it moves to another workbranch. Serial stages process
+ * items in input order, parallel stages process them concurrently.
+ */
+template <typename T>
+class pipeline {
+    using submit_fn = std::function<void(task_t)>;
+
+    struct token {
+        T item = T();
+        size_t seq = 0;
+        bool failed = false;  // a stage threw, later stages only keep the order
+    };
+
+    struct stage {
+        std::function<void(T&)> func;
+        const void* branch = nullptr;
+        submit_fn submit;
+        bool serial = false;
+
+        // serial stages only
+        std::mutex lok;
+        bool busy = false;
+        size_t next = 0;  // sequence number expected
+        std::map<size_t, token*> waiting;
+    };
+
+    std::vector<std::unique_ptr<stage>> stages;
+    std::vector<token> tokens;
+
+    // input and completion, guarded by "lok"
+    std::mutex lok;
+    std::condition_variable finished;
+    std::vector<token*> free_tokens;
+    std::function<bool(T&)> source;
+    const void* input_branch = nullptr;
+    submit_fn input_submit;
+    bool input_scheduled = false;
+    bool input_done = true;
+    bool running = false;
+    size_t in_flight = 0;
+    size_t next_seq = 0;
+    size_t done_items = 0;
+    std::exception_ptr error;
+    std::unique_ptr<std::promise<size_t>> promise;
+
+public:
+    /**
+     * @brief construct a pipeline
+     * @param max_tokens max items in flight (bounds the memory)
+     */
+    explicit pipeline(size_t max_tokens)
+      : tokens(max_tokens ? max_tokens : 1) {
+    }
+    pipeline(const pipeline&) = delete;
+    ~pipeline() {
+        std::unique_lock<std::mutex> lock(lok);
+        finished.wait(lock, [this] { return !running; });
+    }
+
+    /**
+     * @brief append a stage processing one item at a time, in input order
+     * @param br workbranch running the stage
+     * @param func callable as func(T&)
+     * @return reference of the pipeline
+     */
+    template <typename Branch, typename F>
+    pipeline& serial(Branch& br, F&& func) {
+        return add_stage(br, std::forward<F>(func), true);
+    }
+
+    /**
+     * @brief append a stage processing items concurrently
+     * @param br workbranch running the stage
+     * @param func callable as func(T&)
+     * @return reference of the pipeline
+     */
+    template <typename Branch, typename F>
+    pipeline& parallel(Branch& br, F&& func) {
+        return add_stage(br, std::forward<F>(func), false);
+    }
+
+    /**
+     * @brief run the pipeline
+     * @param br workbranch running the input
+     * @param input callable as bool(T&), fills the item and returns false at the end
+     * @return std::future<size_t> of the number of items that went through all stages,
+     * or of the first exception thrown by a stage or the input
+     */
+    template <typename Branch, typename F>
+    std::future<size_t> run(Branch& br, F&& input) {
+        std::lock_guard<std::mutex> lock(lok);
+        if (running) throw std::runtime_error("workspace: Pipeline is running");
+        for (auto& st : stages) {
+            st->next = 0;
+            st->waiting.clear();
+        }
+        free_tokens.clear();
+        for (auto& t : tokens) free_tokens.push_back(&t);
+        source = std::forward<F>(input);
+        input_branch = &br;
+        input_submit = [&br](task_t task) { br.submit(std::move(task)); };
+        input_done = false;
+        running = true;
+        in_flight = 0;
+        next_seq = 0;
+        done_items = 0;
+        error = nullptr;
+        promise.reset(new std::promise<size_t>);
+        auto fut = promise->get_future();
+        schedule_input();
+        return fut;
+    }
+
+private:
+    template <typename Branch, typename F>
+    pipeline& add_stage(Branch& br, F&& func, bool serial) {
+        std::lock_guard<std::mutex> lock(lok);
+        if (running) throw std::runtime_error("workspace: Pipeline is running");
+        std::unique_ptr<stage> st(new stage);
+        st->func = std::forward<F>(func);
+        st->branch = &br;
+        st->submit = [&br](task_t task) { br.submit(std::move(task)); };
+        st->serial = serial;
+        stages.emplace_back(std::move(st));
+        return *this;
+    }
+
+    // under "lok": queue the input task if a token is free
+    void schedule_input() {
+        if (input_scheduled || input_done || free_tokens.empty()) return;
+        input_scheduled = true;
+        input_submit([this] { read_input(); });
+    }
+
+    // read one item, let another task read the next one, carry the item on this thread
+    void read_input() {
+        token* t;
+        {
+            std::lock_guard<std::mutex> lock(lok);
+            if (input_done) {  // stopped by an exception
+                input_scheduled = false;
+                check_finished();
+                return;
+            }
+            t = free_tokens.back();
+            free_tokens.pop_back();
+            in_flight++;
+        }
+        bool more = false;
+        try {
+            more = source(t->item);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(lok);
+            if (!error) error = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(lok);
+            input_scheduled = false;
+            if (!more) {
+                input_done = true;
+                free_tokens.push_back(t);
+                in_flight--;
+                check_finished();
+                return;
+            }
+            t->seq = next_seq++;
+            t->failed = false;
+            schedule_input();
+        }
+        carry(t, 0, input_branch);
+    }
+
+    // move the token through the stages from "i", running on the branch "here"
+    void carry(token* t, size_t i, const void* here) {
+        while (i < stages.size()) {
+            auto& st = *stages[i];
+            if (st.branch != here) {  // hop to another workbranch
+                st.submit([this, t, i, &st] { carry(t, i, st.branch); });
+                return;
+            }
+            if (st.serial) {
+                {
+                    std::lock_guard<std::mutex> lock(st.lok);
+                    if (st.busy || t->seq != st.next) {
+                        st.waiting.emplace(t->seq, t);  // resumed by its predecessor
+                        return;
+                    }
+                    st.busy = true;
+                }
+                run_serial(t, i);
+            } else {
+                process(st, t);
+            }
+            ++i;
+        }
+        retire(t);
+    }
+
+    // run a serial stage owned by the token, then hand the stage to the next item in order
+    void run_serial(token* t, size_t i) {
+        auto& st = *stages[i];
+        process(st, t);
+        token* successor = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(st.lok);
+            st.next++;
+            auto it = st.waiting.find(st.next);
+            if (it != st.waiting.end()) {
+                successor = it->second;
+                st.waiting.erase(it);
+            } else {
+                st.busy = false;
+            }
+        }
+        if (successor) {
+            st.submit([this, successor, i, &st] {
+                run_serial(successor, i);
+                carry(successor, i + 1, st.branch);
+            });
+        }
+    }
+
+    void process(stage& st, token* t) {
+        if (t->failed) return;
+        try {
+            st.func(t->item);
+        } catch (...) {
+            t->failed = true;
+            std::lock_guard<std::mutex> lock(lok);
+            if (!error) error = std::current_exception();
+            input_done = true;  // stop reading
+        }
+    }
+
+    void retire(token* t) {
+        std::lock_guard<std::mutex> lock(lok);
+        if (!t->failed) done_items++;
+        free_tokens.push_back(t);
+        in_flight--;
+        schedule_input();
+        check_finished();
+    }
+
+    // under "lok"
+    void check_finished() {
+        if (!input_done || in_flight || input_scheduled) return;
+        if (error) {
+            promise->set_exception(error);
+        } else {
+            promise->set_value(done_items);
+        }
+        running = false;
+        finished.notify_all();
+    }
+};
+
+}  // namespace details
+}  // namespace wsp
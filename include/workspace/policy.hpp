@@ -0,0 +1,222 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <workspace/errorsink.hpp>
+#include <workspace/metrics.hpp>
+
+namespace wsp {
+
+enum class waitstrategy {
+    lowlatancy,  // Busy-wait with std::this_thread::yield(), minimal latency.
+    balance,     // Busy-wait initially, then sleep briefly after max_spin_count.
+    blocking     // Block thread using condition variables until a task is available
+                 // or conditions are met.
+};
+
+namespace details {
+
+/**
+ * @brief Where idle workers block
+ * @note Notifying is lock-free unless some worker is blocking.
+ */
+class waiter {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::atomic<int> sleepers{0};
+
+public:
+    template <typename Pred>
+    void wait(Pred&& wake) {
+        std::unique_lock<std::mutex> lock(mtx);
+        sleepers.fetch_add(1);
+        cv.wait(lock, std::forward<Pred>(wake));
+        sleepers.fetch_sub(1);
+    }
+    template <typename Pred>
+    void wait_for(uint64_t ns, Pred&& wake) {
+        std::unique_lock<std::mutex> lock(mtx);
+        sleepers.fetch_add(1);
+        cv.wait_for(lock, std::chrono::nanoseconds(ns), std::forward<Pred>(wake));
+        sleepers.fetch_sub(1);
+    }
+    void notify_one() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load()) {
+            { std::lock_guard<std::mutex> lock(mtx); }
+            cv.notify_one();
+        }
+    }
+    void notify_all() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load()) {
+            { std::lock_guard<std::mutex> lock(mtx); }
+            cv.notify_all();
+        }
+    }
+};
+
+// Wait policy: busy-wait with std::this_thread::yield()
+struct lowlatancy_wait {
+    template <typename Pred>
+    void idle(waiter&, worker_stats& stats, int&, Pred&&) {
+        bump(stats.spins);
+        std::this_thread::yield();
+    }
+    // idle for at most "ns" (the worker comes back soon anyway)
+    template <typename Pred>
+    void idle_for(waiter& w, worker_stats& stats, int& spin_count, uint64_t, Pred&& wake) {
+        idle(w, stats, spin_count, std::forward<Pred>(wake));
+    }
+    // timeout of polling the reactor while idle (ms)
+    int poll_timeout(int&) {
+        return 0;
+    }
+    void notify_one(waiter&) {
+    }
+    void notify_all(waiter&) {
+    }
+};
+
+// Wait policy: busy-wait initially, then sleep briefly after max_spin_count
+struct balance_wait {
+    static constexpr int max_spin_count = 10000;
+
+    template <typename Pred>
+    void idle(waiter&, worker_stats& stats, int& spin_count, Pred&&) {
+        if (spin_count < max_spin_count) {
+            ++spin_count;
+            bump(stats.spins);
+            std::this_thread::yield();
+        } else {
+            bump(stats.parks);
+            // Just tell the system to suspend this thread in the shortest time
+            std::this_thread::sleep_for(std::chrono::nanoseconds(1));
+        }
+    }
+    template <typename Pred>
+    void idle_for(waiter& w, worker_stats& stats, int& spin_count, uint64_t, Pred&& wake) {
+        idle(w, stats, spin_count, std::forward<Pred>(wake));
+    }
+    int poll_timeout(int& spin_count) {
+        if (spin_count < max_spin_count) {
+            ++spin_count;
+            return 0;
+        }
+        return 1;
+    }
+    void notify_one(waiter&) {
+    }
+    void notify_all(waiter&) {
+    }
+};
+
+// Wait policy: block until a task is available or conditions are met
+struct blocking_wait {
+    template <typename Pred>
+    void idle(waiter& w, worker_stats& stats, int&, Pred&& wake) {
+        bump(stats.parks);
+        w.wait(std::forward<Pred>(wake));
+    }
+    // park for at most "ns"
+    template <typename Pred>
+    void idle_for(waiter& w, worker_stats& stats, int&, uint64_t ns, Pred&& wake) {
+        bump(stats.parks);
+        w.wait_for(ns, std::forward<Pred>(wake));
+    }
+    int poll_timeout(int&) {
+        return -1;  // until interrupted
+    }
+    void notify_one(waiter& w) {
+        w.notify_one();
+    }
+    void notify_all(waiter& w) {
+        w.notify_all();
+    }
+};
+
+// Wait policy: choose the strategy at runtime
+class dynamic_wait {
+    waitstrategy strategy;
+
+public:
+    dynamic_wait(waitstrategy s = waitstrategy::lowlatancy)
+      : strategy(s) {
+    }
+
+    template <typename Pred>
+    void idle(waiter& w, worker_stats& stats, int& spin_count, Pred&& wake) {
+        switch (strategy) {
+            case waitstrategy::lowlatancy: {
+                lowlatancy_wait().idle(w, stats, spin_count, std::forward<Pred>(wake));
+                break;
+            }
+            case waitstrategy::balance: {
+                balance_wait().idle(w, stats, spin_count, std::forward<Pred>(wake));
+                break;
+            }
+            case waitstrategy::blocking: {
+                blocking_wait().idle(w, stats, spin_count, std::forward<Pred>(wake));
+                break;
+            }
+        }
+    }
+    template <typename Pred>
+    void idle_for(waiter& w, worker_stats& stats, int& spin_count, uint64_t ns, Pred&& wake) {
+        if (strategy == waitstrategy::blocking) {
+            blocking_wait().idle_for(w, stats, spin_count, ns, std::forward<Pred>(wake));
+        } else {
+            idle(w, stats, spin_count, std::forward<Pred>(wake));
+        }
+    }
+    int poll_timeout(int& spin_count) {
+        switch (strategy) {
+            case waitstrategy::lowlatancy: {
+                return lowlatancy_wait().poll_timeout(spin_count);
+            }
+            case waitstrategy::balance: {
+                return balance_wait().poll_timeout(spin_count);
+            }
+            case waitstrategy::blocking: {
+                return blocking_wait().poll_timeout(spin_count);
+            }
+        }
+        return 0;
+    }
+    void notify_one(waiter& w) {
+        if (strategy == waitstrategy::blocking) w.notify_one();
+    }
+    void notify_all(waiter& w) {
+        if (strategy == waitstrategy::blocking) w.notify_all();
+    }
+};
+
+// Exception policy: catch the exceptions thrown by tasks and report them to the error sink
+struct log_exceptions {
+    template <typename F>
+    static void invoke(F&& task, error_sink& sink) {
+        try {
+            task();
+        } catch (const std::exception& ex) {
+            count_exception();
+            sink.report(ex);
+        } catch (...) {
+            count_exception();
+            sink.report_unknown();
+        }
+    }
+};
+
+// Exception policy: no try/catch at all, an escaped exception terminates the program
+struct ignore_exceptions {
+    template <typename F>
+    static void invoke(F&& task, error_sink&) {
+        task();
+    }
+};
+
+}  // namespace details
+}  // namespace wsp
@@ -0,0 +1,203 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#define WSP_HAS_REACTOR 1
+#else
+#define WSP_HAS_REACTOR 0
+#endif
+
+namespace wsp {
+namespace details {
+
+/**
+ * @brief epoll instance polled by idle workers
+ * @note Every fd is watched in one-shot mode and rearmed after its handler returns,
+ * so a handler never runs concurrently with itself. A write to an eventfd
+ * interrupts the worker blocking in epoll_wait() when a task arrives.
+ */
+class reactor {
+public:
+    using handler_t = std::function<void(int fd, uint32_t events)>;
+
+    // ready fd taken out of epoll, run it then call rearm()
+    struct ready {
+        std::shared_ptr<handler_t> handler;
+        int fd;
+        uint32_t events;
+    };
+
+private:
+    struct entry {
+        std::shared_ptr<handler_t> handler;
+        uint32_t events;
+        uint64_t key;  // generation << 32 | fd
+    };
+
+    static constexpr int max_events = 16;
+    static constexpr uint64_t wakeup_key = 0;
+
+    int epfd = -1;
+    int evfd = -1;
+    std::mutex lok;
+    std::map<int, entry> entries;  // by fd
+    uint64_t generation = 1;
+    std::atomic<int> pollers{0};        // workers blocking in epoll_wait()
+    std::atomic<bool> signaled{false};  // eventfd written and not read yet
+    std::atomic<bool> polling{false};   // a worker is in poll()
+
+public:
+    reactor() {
+#if WSP_HAS_REACTOR
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epfd < 0 || evfd < 0) {
+            close_fds();
+            throw std::runtime_error("workspace: Failed to create the reactor");
+        }
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = wakeup_key;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, evfd, &ev);
+#else
+        throw std::runtime_error("workspace: Reactor is not supported on this platform");
+#endif
+    }
+    reactor(const reactor&) = delete;
+    ~reactor() {
+        close_fds();
+    }
+
+    /**
+     * @brief watch the fd
+     * @param fd file descriptor (owned by the caller)
+     * @param events epoll events such as EPOLLIN (EPOLLONESHOT is added)
+     * @param handler called with the fd and the events that are ready
+     */
+    void watch(int fd, uint32_t events, handler_t handler) {
+#if WSP_HAS_REACTOR
+        std::lock_guard<std::mutex> lock(lok);
+        auto key = (generation++ << 32) | static_cast<uint32_t>(fd);
+        epoll_event ev = {};
+        ev.events = events | EPOLLONESHOT;
+        ev.data.u64 = key;
+        int op = entries.count(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (epoll_ctl(epfd, op, fd, &ev) < 0) {
+            throw std::runtime_error("workspace: Failed to watch fd " + std::to_string(fd));
+        }
+        entries[fd] = entry{std::make_shared<handler_t>(std::move(handler)), events, key};
+#else
+        (void)fd, (void)events, (void)handler;
+#endif
+    }
+
+    /**
+     * @brief stop watching the fd
+     * @note A handler already running is not interrupted.
+     */
+    void unwatch(int fd) {
+#if WSP_HAS_REACTOR
+        std::lock_guard<std::mutex> lock(lok);
+        if (entries.erase(fd)) epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+#else
+        (void)fd;
+#endif
+    }
+
+    /**
+     * @brief wait for ready fds (only one worker polls at a time)
+     * @param out ready fds (appended)
+     * @param timeout_ms 0: do not wait, -1: wait until ready or interrupted
+     * @param keep_waiting checked after announcing the wait, returning false skips the wait
+     * @return false if another worker is polling
+     */
+    template <typename Pred>
+    bool poll(std::vector<ready>& out, int timeout_ms, Pred&& keep_waiting) {
+#if WSP_HAS_REACTOR
+        if (polling.load(std::memory_order_relaxed) || polling.exchange(true, std::memory_order_acquire)) return false;
+        if (timeout_ms) {
+            pollers.fetch_add(1);
+            if (!keep_waiting()) timeout_ms = 0;
+        }
+        epoll_event evs[max_events];
+        int n = epoll_wait(epfd, evs, max_events, timeout_ms);
+        if (timeout_ms) pollers.fetch_sub(1);
+        for (int i = 0; i < n; ++i) {
+            if (evs[i].data.u64 == wakeup_key) {
+                uint64_t count;
+                while (read(evfd, &count, sizeof(count)) > 0) {
+                }
+                signaled.store(false);
+                continue;
+            }
+            auto key = evs[i].data.u64;
+            int fd = static_cast<int>(key & 0xffffffffu);
+            std::lock_guard<std::mutex> lock(lok);
+            auto it = entries.find(fd);
+            if (it != entries.end() && it->second.key == key) {  // not unwatched meanwhile
+                out.push_back(ready{it->second.handler, fd, evs[i].events});
+            }
+        }
+        polling.store(false, std::memory_order_release);
+        return true;
+#else
+        (void)out, (void)timeout_ms, (void)keep_waiting;
+        return false;
+#endif
+    }
+
+    // watch the fd again after its handler returned
+    void rearm(const ready& r) {
+#if WSP_HAS_REACTOR
+        std::lock_guard<std::mutex> lock(lok);
+        auto it = entries.find(r.fd);
+        if (it == entries.end() || it->second.handler != r.handler) return;  // unwatched or replaced
+        epoll_event ev = {};
+        ev.events = it->second.events | EPOLLONESHOT;
+        ev.data.u64 = it->second.key;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, r.fd, &ev);
+#else
+        (void)r;
+#endif
+    }
+
+    // no worker is polling
+    bool vacant() const {
+        return !polling.load();
+    }
+
+    // wake the worker blocking in epoll_wait() (lock-free if none)
+    void interrupt() {
+#if WSP_HAS_REACTOR
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (pollers.load() && !signaled.exchange(true)) {
+            uint64_t one = 1;
+            ssize_t res = write(evfd, &one, sizeof(one));
+            (void)res;
+        }
+#endif
+    }
+
+private:
+    void close_fds() {
+#if WSP_HAS_REACTOR
+        if (epfd >= 0) ::close(epfd);
+        if (evfd >= 0) ::close(evfd);
+#endif
+        epfd = evfd = -1;
+    }
+};
+
+}  // namespace details
+}  // namespace wsp
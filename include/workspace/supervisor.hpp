@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include <cassert>
 #include <condition_variable>
 #include <iomanip>
@@ -6,31 +7,79 @@
 #include <mutex>
 #include <thread>
 #include <vector>
+#include <workspace/metrics.hpp>
 #include <workspace/utility.hpp>
 #include <workspace/workbranch.hpp>
 
 namespace wsp {
 namespace details {
 
+// a task running longer than the limit of the stall detector
+struct stall_info {
+    size_t branch = 0;       // index of the workbranch in order of supervising
+    size_t worker = 0;       // index of the worker
+    uint64_t task = 0;       // sequence number of the task in the worker slot
+    uint64_t running_ms = 0;  // at least this long (measured in ticks)
+    bool compensated = false;  // a worker was added for it
+};
+
+// tag of a supervisor without a thread, driven by supervisor::tick()
+struct manual_tick_t {};
+
 // workbranch supervisor
 class supervisor {
     using tick_callback_t = std::function<void()>;
+    using stats_callback_t = std::function<void(const std::vector<branch_snapshot>&)>;
+    using stall_callback_t = std::function<void(const stall_info&)>;
+
+    // last heartbeat seen from a worker
+    struct beat {
+        uint64_t epoch = 0;
+        uint64_t since = 0;  // when the epoch was first seen (ns)
+        bool stalled = false;
+    };
+
+    // supervised workbranch and its share settings
+    struct branch_ctl {
+        branch_base* pbr = nullptr;
+        double weight = 1.0;
+        size_t wmin = 0;
+        std::vector<beat> beats;  // by worker index
+        size_t stalled = 0;       // workers stuck in a task, not counted as capacity
+        uint64_t busy_ns = 0;     // counters of the last tick
+        uint64_t busy_cpu_ns = 0;
+        bool blocked = false;   // tasks spend little of their time on CPU
+        bool growable = true;  // more workers may help
+    };
 
 private:
-    bool stop = false;
+    std::atomic<bool> stop{false};
 
     size_t wmin = 0;
     size_t wmax = 0;
+    size_t budget = 0;  // 0: unlimited
     unsigned tout = 0;
     const unsigned tval = 0;
 
-    tick_callback_t tick_cb = {};
+    stats_callback_t tick_cb = {};
+    stall_callback_t stall_cb = {};
+    uint64_t stall_ns = 0;  // 0: no stall detection
+    bool compensate = false;
+    std::vector<stall_info> stalls;  // found in each tick
+    std::vector<uint64_t> epochs;
+    double max_cpu_load = 0;   // 0: not limited
+    double min_cpu_ratio = 0;  // 0: not limited
+    uint64_t last_wall = 0;
+    uint64_t last_cpu = 0;
+    error_sink esink{"supervisor"};
+    std::vector<branch_snapshot> snaps;  // taken in each tick
 
-    autothread<join> worker;
-    std::vector<workbranch*> branches;
+    std::vector<branch_ctl> branches;
     std::condition_variable thrd_cv;
     std::mutex spv_lok;
 
+    autothread<join> worker;  // declared last: started after and joined before the members above
+
 public:
     /**
      * @brief construct a supervisor
@@ -39,20 +88,34 @@ public:
      * @param time_interval  time interval between each check
      */
     explicit supervisor(int min_wokrs, int max_wokrs, unsigned time_interval = 500)
+      : supervisor(min_wokrs, max_wokrs, time_interval, true) {
+    }
+    /**
+     * @brief construct a supervisor without a thread, it checks only when tick() is called
+     * @param min_wokrs min nums of workers
+     * @param max_wokrs max nums of workers
+     */
+    supervisor(int min_wokrs, int max_wokrs, manual_tick_t)
+      : supervisor(min_wokrs, max_wokrs, 0, false) {
+    }
+    supervisor(const supervisor&) = delete;
+    supervisor(supervisor&&) = delete;
+private:
+    supervisor(int min_wokrs, int max_wokrs, unsigned time_interval, bool threaded)
       : wmin(min_wokrs)
       , wmax(max_wokrs)
       , tout(time_interval)
       , tval(time_interval)
-      , tick_cb([] {})
-      , worker(std::thread(&supervisor::mission, this)) {
+      , tick_cb([](const std::vector<branch_snapshot>&) {})
+      , worker(threaded ? std::thread(&supervisor::mission, this) : std::thread()) {
         assert(min_wokrs >= 0 && max_wokrs > 0 && max_wokrs > min_wokrs);
     }
-    supervisor(const supervisor&) = delete;
-    supervisor(supervisor&&) = delete;
+
+public:
     ~supervisor() {
         {
             std::lock_guard<std::mutex> lock(spv_lok);
-            stop = true;
+            stop.store(true);
             thrd_cv.notify_one();
         }
     }
@@ -62,9 +125,39 @@ public:
      * @brief start supervising a workbranch
      * @param wbr reference of workbranch
      */
-    void supervise(workbranch& wbr) {
+    void supervise(branch_base& wbr) {
         std::lock_guard<std::mutex> lock(spv_lok);
-        branches.emplace_back(&wbr);
+        branch_ctl ctl;
+        ctl.pbr = &wbr;
+        ctl.wmin = wmin;
+        branches.emplace_back(ctl);
+    }
+
+    /**
+     * @brief start supervising a workbranch with its own share of the budget
+     * @param wbr reference of workbranch
+     * @param weight relative weight when dividing the budget (> 0)
+     * @param min_wokrs guaranteed min nums of workers of this workbranch
+     */
+    void supervise(branch_base& wbr, double weight, int min_wokrs) {
+        assert(weight > 0 && min_wokrs >= 0 && (size_t)min_wokrs <= wmax);
+        std::lock_guard<std::mutex> lock(spv_lok);
+        branch_ctl ctl;
+        ctl.pbr = &wbr;
+        ctl.weight = weight;
+        ctl.wmin = min_wokrs;
+        branches.emplace_back(ctl);
+    }
+
+    /**
+     * @brief limit the total number of workers of all supervised workbranches
+     * @param max_wokrs thread budget shared by the workbranches (0 means no limit)
+     * @note The budget is divided in proportion to each workbranch's load and weight,
+     * and the guaranteed minimums are served first.
+     */
+    void set_budget(size_t max_wokrs) {
+        std::lock_guard<std::mutex> lock(spv_lok);
+        budget = max_wokrs;
     }
 
     /**
@@ -88,42 +181,302 @@ public:
      * @param cb callback function
      */
     void set_tick_cb(tick_callback_t cb) {
+        std::lock_guard<std::mutex> lock(spv_lok);
+        tick_cb = [cb](const std::vector<branch_snapshot>&) { cb(); };
+    }
+    /**
+     * @brief Always execute callback before taking a rest
+     * @param cb callback function receiving the snapshots of the supervised
+     * workbranches (in order of supervising)
+     */
+    void set_tick_cb(stats_callback_t cb) {
+        std::lock_guard<std::mutex> lock(spv_lok);
         tick_cb = cb;
     }
+    /**
+     * @brief detect the tasks running longer than a limit
+     * @param max_runtime_ms runtime limit (0 stops detecting)
+     * @param cb callback called once for each stalled task, on the supervisor thread
+     * @param add_worker whether to add a worker to the workbranch for each stalled task
+     * @note Workers publish a heartbeat when a task starts and ends, the supervisor compares
+     * them between ticks, so the runtime is measured with the accuracy of the interval.
+     * A stalled worker is not counted as a worker of its workbranch until its task ends.
+     */
+    void set_stall_detector(unsigned max_runtime_ms, stall_callback_t cb, bool add_worker = false) {
+        std::lock_guard<std::mutex> lock(spv_lok);
+        stall_ns = uint64_t(max_runtime_ms) * 1000000;
+        stall_cb = std::move(cb);
+        compensate = add_worker;
+    }
+    /**
+     * @brief stop adding workers when they would only add contention
+     * @param max_load no worker is added while the process uses more than this share
+     * of all cores, such as 0.9 (0: not limited)
+     * @param min_ratio no worker is added to a workbranch whose workers spend less than
+     * this share of their busy time on CPU, such as when they block on locks (0: not limited)
+     * @note The CPU time of the workers is sampled only when they switch between busy and
+     * idle, and is also reported by branch_snapshot (busy_cpu_ns and idle_cpu_ns).
+     */
+    void set_cpu_limits(double max_load, double min_ratio = 0) {
+        std::lock_guard<std::mutex> lock(spv_lok);
+        max_cpu_load = max_load > 0 ? max_load : 0;
+        min_cpu_ratio = min_ratio > 0 ? min_ratio : 0;
+        for (auto& ctl : branches) ctl.blocked = false;
+    }
+    /**
+     * @brief check and adjust the workbranches once on the calling thread, then run the tick callback
+     * @note Meant for a supervisor constructed with wsp::manual_tick. Exceptions are thrown
+     * to the caller instead of the error handler.
+     */
+    void tick() {
+        tick_at(now_ns(), true);
+    }
+    /**
+     * @brief tick at a time of the caller's clock, such as a simulated one
+     * @param virtual_ns time of this tick (ns, never going back)
+     * @note Stall detection measures the runtimes on this clock. The process CPU load limit of
+     * set_cpu_limits() only exists on the real clock and is not applied; the CPU ratio of the
+     * workbranches still comes from their snapshots. Do not mix it with tick().
+     */
+    void tick(uint64_t virtual_ns) {
+        tick_at(virtual_ns, false);
+    }
+    /**
+     * @brief handle the exceptions thrown in supervising (such as by the tick callback)
+     * @param cb callback called on the supervisor thread
+     */
+    void set_error_handler(error_sink::handler_t cb) {
+        esink.set_handler(std::move(cb));
+    }
+    /**
+     * @brief get the error sink (counters and draining of the default ring)
+     * @return reference of the error sink
+     */
+    error_sink& errors() {
+        return esink;
+    }
 
 private:
+    void tick_at(uint64_t now, bool real_clock) {
+        stats_callback_t cb;
+        {
+            std::unique_lock<std::mutex> lock(spv_lok);
+            check(lock, now, real_clock);
+            cb = tick_cb;
+        }
+        cb(snaps);
+    }
+
     // loop func
     void mission() {
-        while (!stop) {
+        stats_callback_t cb;
+        while (!stop.load()) {
             try {
                 {
                     std::unique_lock<std::mutex> lock(spv_lok);
-                    for (auto pbr : branches) {
-                        // get info
-                        auto tknums = pbr->num_tasks();
-                        auto wknums = pbr->num_workers();
-                        // adjust
-                        if (tknums) {
-                            assert(wknums <= wmax);  // Avoid wrong usage
-                            size_t nums = std::min(wmax - wknums, tknums - wknums);
-                            for (size_t i = 0; i < nums; ++i) {
-                                pbr->add_worker();  // quick add
-                            }
-                        } else if (wknums > wmin) {
-                            pbr->del_worker();  // slow dec
-                        }
-                    }
-                    if (!stop) thrd_cv.wait_for(lock, std::chrono::milliseconds(tout));
+                    check(lock, now_ns(), true);
+                    if (!stop.load()) thrd_cv.wait_for(lock, std::chrono::milliseconds(tout));
+                    cb = tick_cb;
                 }
-                tick_cb();  // execute tick callback
+                cb(snaps);  // execute tick callback
 
             } catch (const std::exception& e) {
-                std::cerr << "workspace: supervisor[" << std::this_thread::get_id() << "] caught exception:\n  \
-                what(): " << e.what()
-                          << '\n'
-                          << std::flush;
+                esink.report(e);
+            } catch (...) {
+                esink.report_unknown();
+            }
+        }
+    }
+
+    // take the snapshots and adjust the workbranches at "now" (under "spv_lok")
+    void check(std::unique_lock<std::mutex>& lock, uint64_t now, bool real_clock) {
+        snaps.clear();
+        for (auto& ctl : branches) {
+            snaps.emplace_back(ctl.pbr->snapshot());
+        }
+        detect_stalls(now);
+        measure_cpu(now, real_clock);
+        if (budget) {
+            regulate_with_budget();
+        } else {
+            regulate();
+        }
+        auto on_stall = stall_cb;
+        if (!stalls.empty() && on_stall) {
+            lock.unlock();
+            for (auto& each : stalls) on_stall(each);
+            lock.lock();
+        }
+    }
+
+    // find the workers whose heartbeat did not change for too long
+    void detect_stalls(uint64_t now) {
+        stalls.clear();
+        for (size_t i = 0; i < branches.size(); ++i) {
+            auto& ctl = branches[i];
+            ctl.stalled = 0;
+            if (!stall_ns) continue;
+            ctl.pbr->heartbeats(epochs);
+            ctl.beats.resize(epochs.size());
+            for (size_t w = 0; w < epochs.size(); ++w) {
+                auto& last = ctl.beats[w];
+                if (epochs[w] != last.epoch) {  // moved on
+                    last.epoch = epochs[w];
+                    last.since = now;
+                    last.stalled = false;
+                    continue;
+                }
+                if (!(last.epoch & 1) || now - last.since < stall_ns) continue;  // idle or not yet
+                ctl.stalled++;
+                if (last.stalled) continue;  // reported
+                last.stalled = true;
+                stall_info info;
+                info.branch = i;
+                info.worker = w;
+                info.task = last.epoch / 2;
+                info.running_ms = (now - last.since) / 1000000;
+                if (compensate && snaps[i].workers - ctl.stalled < wmax && (!budget || threads() < budget)) {
+                    ctl.pbr->add_worker();
+                    snaps[i].workers++;
+                    info.compensated = true;
+                }
+                stalls.emplace_back(info);
+            }
+        }
+    }
+
+    // decide which workbranches may grow from the CPU time since the last tick
+    void measure_cpu(uint64_t wall, bool real_clock) {
+        bool saturated = false;
+        if (real_clock) {  // process CPU time against virtual time means nothing
+            auto cpu = process_cpu_ns();
+            if (max_cpu_load > 0 && last_wall && wall > last_wall && cpu >= last_cpu) {
+                auto cores = std::max(std::thread::hardware_concurrency(), 1u);
+                saturated = double(cpu - last_cpu) / (double(wall - last_wall) * cores) >= max_cpu_load;
+            }
+            last_wall = wall;
+            last_cpu = cpu;
+        }
+        for (size_t i = 0; i < branches.size(); ++i) {
+            auto& ctl = branches[i];
+            auto& snap = snaps[i];
+            auto busy = snap.busy_sampled_ns - std::min(ctl.busy_ns, snap.busy_sampled_ns);
+            auto busy_cpu = snap.busy_cpu_ns - std::min(ctl.busy_cpu_ns, snap.busy_cpu_ns);
+            if (busy) {  // otherwise keep the last decision
+                ctl.blocked = min_cpu_ratio > 0 && double(busy_cpu) / busy < min_cpu_ratio;
+            }
+            ctl.growable = !saturated && !ctl.blocked;
+            ctl.busy_ns = snap.busy_sampled_ns;
+            ctl.busy_cpu_ns = snap.busy_cpu_ns;
+        }
+    }
+
+    // workers of the ith workbranch that are not stalled or leaving
+    size_t live_workers(size_t i) const {
+        auto staying = snaps[i].workers - snaps[i].declining;
+        return staying - std::min<uint64_t>(branches[i].stalled, staying);
+    }
+    // threads of all workbranches, stalled ones included (counted against the budget)
+    size_t threads() const {
+        size_t total = 0;
+        for (auto& snap : snaps) total += snap.workers - snap.declining;
+        return total;
+    }
+
+    // every workbranch scales independently within [wmin, wmax]
+    // (stalled workers and the ones leaving are not counted)
+    void regulate() {
+        for (size_t i = 0; i < branches.size(); ++i) {
+            auto& ctl = branches[i];
+            // get info
+            size_t tknums = snaps[i].tasks;
+            size_t wknums = live_workers(i);
+            // adjust
+            if (wknums > wmax) {  // such as a stalled task ended after a worker was added for it
+                ctl.pbr->del_worker();
+            } else if (tknums) {
+                if (!ctl.growable) continue;  // cores saturated or tasks not CPU-bound
+                size_t nums = std::min(wmax - wknums, tknums - wknums);
+                for (size_t k = 0; k < nums; ++k) {
+                    ctl.pbr->add_worker();  // quick add
+                }
+            } else if (wknums > ctl.wmin) {
+                ctl.pbr->del_worker();  // slow dec
+            }
+        }
+    }
+
+    // workbranches share the budget, total workers never exceed it
+    void regulate_with_budget() {
+        size_t n = branches.size();
+        std::vector<size_t> tknums(n), wknums(n), demand(n), floor(n);
+        size_t total = threads();  // stalled workers still hold their threads
+        for (size_t i = 0; i < n; ++i) {
+            tknums[i] = snaps[i].tasks;
+            wknums[i] = live_workers(i);
+            floor[i] = std::min(branches[i].wmin, wmax);
+            if (tknums[i] && !branches[i].growable) {
+                demand[i] = std::max(floor[i], wknums[i]);  // keep
+            } else if (tknums[i]) {
+                demand[i] = std::max(floor[i], std::min(wmax, std::max(wknums[i], tknums[i])));
+            } else {
+                demand[i] = std::max(floor[i], wknums[i] > floor[i] ? wknums[i] - 1 : wknums[i]);  // slow dec
+            }
+        }
+        auto share = divide_budget(tknums, demand, floor);
+
+        // shrink first, then grow within the room left by the live workers
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t k = share[i]; k < wknums[i]; ++k) {
+                branches[i].pbr->del_worker();
+            }
+        }
+        size_t room = total < budget ? budget - total : 0;
+        for (size_t i = 0; i < n && room; ++i) {
+            for (size_t k = wknums[i]; k < share[i] && room; ++k, --room) {
+                branches[i].pbr->add_worker();
+            }
+        }
+    }
+
+    // guaranteed minimums first, then the rest in proportion to weight * load
+    std::vector<size_t> divide_budget(const std::vector<size_t>& load, const std::vector<size_t>& demand,
+                                      const std::vector<size_t>& floor) {
+        size_t n = branches.size();
+        std::vector<size_t> share(n, 0);
+        size_t left = budget;
+        for (size_t i = 0; i < n && left; ++i) {
+            share[i] = std::min(floor[i], left);
+            left -= share[i];
+        }
+        while (left) {
+            double sum = 0;
+            for (size_t i = 0; i < n; ++i) {
+                if (share[i] < demand[i]) sum += branches[i].weight * (load[i] + 1);
+            }
+            if (sum <= 0) break;  // every demand satisfied
+            size_t given = 0;
+            size_t best = n;
+            double best_frac = -1;
+            for (size_t i = 0; i < n; ++i) {
+                if (share[i] >= demand[i]) continue;
+                double quota = left * branches[i].weight * (load[i] + 1) / sum;
+                size_t add = std::min((size_t)quota, demand[i] - share[i]);
+                share[i] += add;
+                given += add;
+                if (share[i] < demand[i] && quota - (size_t)quota > best_frac) {
+                    best_frac = quota - (size_t)quota;
+                    best = i;
+                }
+            }
+            if (!given) {  // hand the remainders out one by one
+                if (best == n) break;
+                share[best]++;
+                given = 1;
             }
+            left -= given;
         }
+        return share;
     }
 };
 
@@ -1,6 +1,9 @@
 #pragma once
+#include <atomic>
+#include <cstdint>
 #include <deque>
 #include <mutex>
+#include <workspace/utility.hpp>
 
 namespace wsp {
 
@@ -9,12 +12,32 @@ namespace details {
 /**
  * @brief A thread-safe task queue
  * @tparam T runnable object
- * @note The performance of pushing back is better
+ * @note The performance of pushing back is better.
+ * Raw tasks take 16 bytes in their own deque, other tasks are stored as T. The order
+ * of the two kinds is kept as runs of tasks of the same kind, so a push only adds
+ * bookkeeping when the kind differs from its neighbour.
  */
 template <typename T>
 class taskqueue {
+    // consecutive tasks of one kind
+    struct run {
+        bool raw;
+        size_t count;
+    };
+
     std::mutex tq_lok;
-    std::deque<T> q;
+    std::deque<T> boxed;
+    std::deque<raw_task> raws;
+    std::deque<run> runs;  // order of the tasks in "boxed" and "raws"
+
+    // written under the lock, readable without it
+    std::atomic<uint64_t> nback{0};
+    std::atomic<uint64_t> nfront{0};
+    std::atomic<uint64_t> npop{0};
+
+    static void incr(std::atomic<uint64_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
 
 public:
     using size_type = typename std::deque<T>::size_type;
@@ -25,32 +48,143 @@ public:
 public:
     void push_back(T& v) {
         std::lock_guard<std::mutex> lock(tq_lok);
-        q.emplace_back(v);
+        boxed.emplace_back(v);
+        back_run(false);
+        incr(nback);
     }
     void push_back(T&& v) {
         std::lock_guard<std::mutex> lock(tq_lok);
-        q.emplace_back(std::move(v));
+        boxed.emplace_back(std::move(v));
+        back_run(false);
+        incr(nback);
+    }
+    void push_back(const raw_task& v) {
+        std::lock_guard<std::mutex> lock(tq_lok);
+        raws.emplace_back(v);
+        back_run(true);
+        incr(nback);
     }
     void push_front(T& v) {
         std::lock_guard<std::mutex> lock(tq_lok);
-        q.emplace_front(v);
+        boxed.emplace_front(v);
+        front_run(false);
+        incr(nfront);
     }
     void push_front(T&& v) {
         std::lock_guard<std::mutex> lock(tq_lok);
-        q.emplace_front(std::move(v));
+        boxed.emplace_front(std::move(v));
+        front_run(false);
+        incr(nfront);
+    }
+    void push_front(const raw_task& v) {
+        std::lock_guard<std::mutex> lock(tq_lok);
+        raws.emplace_front(v);
+        front_run(true);
+        incr(nfront);
     }
     bool try_pop(T& tmp) {
         std::lock_guard<std::mutex> lock(tq_lok);
-        if (!q.empty()) {
-            tmp = std::move(q.front());
-            q.pop_front();
-            return true;
+        if (runs.empty()) return false;
+        auto& first = runs.front();
+        if (first.raw) {
+            tmp = raws.front();
+            raws.pop_front();
+        } else {
+            tmp = std::move(boxed.front());
+            boxed.pop_front();
         }
-        return false;
+        if (!--first.count) runs.pop_front();
+        incr(npop);
+        return true;
     }
     size_type length() {
         std::lock_guard<std::mutex> lock(tq_lok);
-        return q.size();
+        return boxed.size() + raws.size();
+    }
+    // number of tasks pushed back (lock-free)
+    uint64_t pushed_back() const {
+        return nback.load(std::memory_order_relaxed);
+    }
+    // number of tasks pushed front (lock-free)
+    uint64_t pushed_front() const {
+        return nfront.load(std::memory_order_relaxed);
+    }
+    // number of tasks popped (lock-free)
+    uint64_t popped() const {
+        return npop.load(std::memory_order_relaxed);
+    }
+
+private:
+    void back_run(bool raw) {
+        if (runs.empty() || runs.back().raw != raw) {
+            runs.push_back(run{raw, 1});
+        } else {
+            runs.back().count++;
+        }
+    }
+    void front_run(bool raw) {
+        if (runs.empty() || runs.front().raw != raw) {
+            runs.push_front(run{raw, 1});
+        } else {
+            runs.front().count++;
+        }
+    }
+};
+
+/**
+ * @brief Tasks posted to one worker
+ * @note Closed until its worker opens it, posting to a closed mailbox fails.
+ */
+class mailbox {
+    std::mutex mb_lok;
+    std::deque<task_t> q;
+    std::atomic<size_t> count{0};     // lock-free check for the owner
+    std::atomic<uint64_t> ntaken{0};  // tasks taken out, written under the lock
+    bool closed = true;
+
+public:
+    mailbox() = default;
+    mailbox(const mailbox&) = delete;
+
+    void open() {
+        std::lock_guard<std::mutex> lock(mb_lok);
+        closed = false;
+    }
+    bool is_open() {
+        std::lock_guard<std::mutex> lock(mb_lok);
+        return !closed;
+    }
+    bool post(task_t&& task) {
+        std::lock_guard<std::mutex> lock(mb_lok);
+        if (closed) return false;
+        q.emplace_back(std::move(task));
+        count.store(q.size(), std::memory_order_release);
+        return true;
+    }
+    bool try_pop(task_t& task) {
+        if (!count.load(std::memory_order_acquire)) return false;
+        std::lock_guard<std::mutex> lock(mb_lok);
+        if (q.empty()) return false;
+        task = std::move(q.front());
+        q.pop_front();
+        count.store(q.size(), std::memory_order_relaxed);
+        ntaken.store(ntaken.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        return true;
+    }
+    // close the mailbox and take the tasks left
+    void close(std::deque<task_t>& rest) {
+        std::lock_guard<std::mutex> lock(mb_lok);
+        closed = true;
+        rest.swap(q);
+        count.store(0, std::memory_order_relaxed);
+        ntaken.store(ntaken.load(std::memory_order_relaxed) + rest.size(), std::memory_order_release);
+    }
+    size_t size() const {
+        return count.load(std::memory_order_relaxed);
+    }
+    // number of tasks taken out by try_pop() and close()
+    uint64_t taken() const {
+        return ntaken.load(std::memory_order_acquire);
     }
 };
 
@@ -0,0 +1,240 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+// Per-task latency tracing, compiled out unless defined to 1
+#ifndef WSP_ENABLE_TRACE
+#define WSP_ENABLE_TRACE 0
+#endif
+
+// Events kept by each worker (the oldest are overwritten)
+#ifndef WSP_TRACE_CAPACITY
+#define WSP_TRACE_CAPACITY 4096
+#endif
+
+namespace wsp {
+namespace details {
+
+/**
+ * @brief Log-linear latency histogram (HDR-style)
+ * @note Values are grouped by power of two, each group is split into 16 buckets,
+ * so the relative error is below 1/16.
+ */
+class histogram {
+public:
+    static constexpr unsigned sub_bits = 4;
+    static constexpr unsigned sub_count = 1u << sub_bits;
+    static constexpr unsigned bucket_count = (64 - sub_bits + 1) * sub_count;
+
+private:
+    uint64_t counts[bucket_count] = {};
+    uint64_t total = 0;
+    uint64_t vmax = 0;
+
+public:
+    static unsigned index_of(uint64_t v) {
+        if (v < sub_count) return static_cast<unsigned>(v);
+        unsigned msb = 63;
+#if defined(__GNUC__) || defined(__clang__)
+        msb = 63 - __builtin_clzll(v);
+#else
+        while (!(v >> msb)) --msb;
+#endif
+        unsigned shift = msb - sub_bits;
+        return (shift + 1) * sub_count + static_cast<unsigned>((v >> shift) - sub_count);
+    }
+    // the largest value of the bucket
+    static uint64_t value_of(unsigned idx) {
+        if (idx < sub_count) return idx;
+        unsigned shift = idx / sub_count - 1;
+        uint64_t sub = idx % sub_count + sub_count;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    void add(unsigned idx, uint64_t n) {
+        counts[idx] += n;
+        total += n;
+        if (n && value_of(idx) > vmax) vmax = value_of(idx);
+    }
+    void merge(const histogram& other) {
+        for (unsigned i = 0; i < bucket_count; ++i) counts[i] += other.counts[i];
+        total += other.total;
+        if (other.vmax > vmax) vmax = other.vmax;
+    }
+
+    // number of samples
+    uint64_t count() const {
+        return total;
+    }
+    // upper bound of the largest sample (ns)
+    uint64_t max() const {
+        return vmax;
+    }
+    /**
+     * @brief get the percentile
+     * @param p percentile in [0, 100], such as 99.9
+     * @return upper bound of the bucket holding the percentile (ns)
+     */
+    uint64_t percentile(double p) const {
+        if (!total) return 0;
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * total + 0.5);
+        if (rank < 1) rank = 1;
+        if (rank > total) rank = total;
+        uint64_t seen = 0;
+        for (unsigned i = 0; i < bucket_count; ++i) {
+            seen += counts[i];
+            if (seen >= rank) return value_of(i);
+        }
+        return vmax;
+    }
+};
+
+// Histogram written by one worker and read by anyone
+class histogram_recorder {
+    std::atomic<uint64_t> counts[histogram::bucket_count];
+
+public:
+    histogram_recorder() {
+        for (auto& each : counts) each.store(0, std::memory_order_relaxed);
+    }
+    void record(uint64_t v) {
+        auto& c = counts[histogram::index_of(v)];
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    void collect(histogram& h) const {
+        for (unsigned i = 0; i < histogram::bucket_count; ++i) {
+            h.add(i, counts[i].load(std::memory_order_relaxed));
+        }
+    }
+};
+
+// timestamps of a traced task (ns, steady clock)
+struct trace_event {
+    uint64_t id = 0;
+    uint64_t enqueue = 0;
+    uint64_t dequeue = 0;
+    uint64_t start = 0;
+    uint64_t end = 0;
+    size_t worker = 0;  // index of the worker
+};
+
+/**
+ * @brief Single-producer ring of trace events
+ * @note The owner worker pushes without locking, readers drop the events
+ * overwritten while reading.
+ */
+class trace_ring {
+    static constexpr size_t capacity = WSP_TRACE_CAPACITY;
+
+    struct cell {
+        std::atomic<uint64_t> v[5];
+    };
+    std::atomic<cell*> cells{nullptr};  // allocated by the first push
+    std::atomic<uint64_t> head{0};
+
+public:
+    trace_ring() = default;
+    trace_ring(const trace_ring&) = delete;
+    ~trace_ring() {
+        delete[] cells.load(std::memory_order_relaxed);
+    }
+
+    void push(uint64_t id, uint64_t enqueue, uint64_t dequeue, uint64_t start, uint64_t end) {
+        auto buf = cells.load(std::memory_order_relaxed);
+        if (!buf) {
+            buf = new cell[capacity];
+            cells.store(buf, std::memory_order_release);
+        }
+        auto h = head.load(std::memory_order_relaxed);
+        auto& c = buf[h % capacity];
+        c.v[0].store(id, std::memory_order_relaxed);
+        c.v[1].store(enqueue, std::memory_order_relaxed);
+        c.v[2].store(dequeue, std::memory_order_relaxed);
+        c.v[3].store(start, std::memory_order_relaxed);
+        c.v[4].store(end, std::memory_order_relaxed);
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    void collect(std::vector<trace_event>& out, size_t worker) const {
+        auto h = head.load(std::memory_order_acquire);
+        auto buf = cells.load(std::memory_order_acquire);
+        if (!buf) return;
+        auto first = h > capacity ? h - capacity : 0;
+        auto base = out.size();
+        for (auto i = first; i < h; ++i) {
+            auto& c = buf[i % capacity];
+            trace_event ev;
+            ev.id = c.v[0].load(std::memory_order_relaxed);
+            ev.enqueue = c.v[1].load(std::memory_order_relaxed);
+            ev.dequeue = c.v[2].load(std::memory_order_relaxed);
+            ev.start = c.v[3].load(std::memory_order_relaxed);
+            ev.end = c.v[4].load(std::memory_order_relaxed);
+            ev.worker = worker;
+            out.emplace_back(ev);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto now = head.load(std::memory_order_relaxed);
+        if (now > capacity && now - capacity > first) {  // overwritten while reading
+            size_t lost = std::min<uint64_t>(now - capacity - first, h - first);
+            out.erase(out.begin() + base, out.begin() + base + lost);
+        }
+    }
+};
+
+// trace data owned by one worker
+struct worker_trace {
+    trace_ring ring;
+    histogram_recorder wait;  // enqueue -> start
+    histogram_recorder run;   // start -> end
+
+    void record(uint64_t id, uint64_t enqueue, uint64_t dequeue, uint64_t start, uint64_t end) {
+        ring.push(id, enqueue, dequeue, start, end);
+        wait.record(start > enqueue ? start - enqueue : 0);
+        run.record(end > start ? end - start : 0);
+    }
+};
+
+// time the running worker took the task out of the task queue
+inline uint64_t& this_dequeue_ns() {
+    static thread_local uint64_t ns = 0;
+    return ns;
+}
+
+/**
+ * @brief write events in Chrome trace format (open with Perfetto or chrome://tracing)
+ * @note Runs are complete events on the worker's track, queue waits are async events.
+ */
+inline void write_chrome_trace(std::ostream& os, const std::vector<trace_event>& events, int pid) {
+    auto flags = os.flags();
+    auto prec = os.precision();
+    os << std::fixed << std::setprecision(3);
+    os << "{\"traceEvents\":[";
+    bool first = true;
+    auto sep = [&] {
+        if (!first) os << ',';
+        first = false;
+        os << '\n';
+    };
+    for (auto& ev : events) {
+        sep();
+        os << "{\"name\":\"task\",\"cat\":\"run\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << ev.worker
+           << ",\"ts\":" << ev.start / 1e3 << ",\"dur\":" << (ev.end - ev.start) / 1e3
+           << ",\"args\":{\"id\":" << ev.id << ",\"dequeue\":" << ev.dequeue / 1e3 << "}}";
+        sep();
+        os << "{\"name\":\"queue\",\"cat\":\"wait\",\"ph\":\"b\",\"pid\":" << pid << ",\"id\":" << ev.id
+           << ",\"ts\":" << ev.enqueue / 1e3 << '}';
+        sep();
+        os << "{\"name\":\"queue\",\"cat\":\"wait\",\"ph\":\"e\",\"pid\":" << pid << ",\"id\":" << ev.id
+           << ",\"ts\":" << ev.dequeue / 1e3 << '}';
+    }
+    os << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    os.flags(flags);
+    os.precision(prec);
+}
+
+}  // namespace details
+}  // namespace wsp
@@ -1,6 +1,9 @@
 #pragma once
 #include <cstdlib>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
 #include <utility>
 #include <deque>
 #include <functional>
@@ -30,14 +33,33 @@ using result_of_t = typename std::result_of<F(Args...)>::type;
 #endif
 #endif
 
+// avoid false sharing
+constexpr std::size_t cacheline_size = 64;
+
+// Heap objects with cache-line aligned members (operator new of C++11 ignores over-alignment)
+struct cache_aligned {
+    static void* operator new(std::size_t size) {
+        void* raw = std::malloc(size + cacheline_size + sizeof(void*));
+        if (!raw) throw std::bad_alloc();
+        auto addr = (reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*) + cacheline_size - 1) &
+                    ~static_cast<std::uintptr_t>(cacheline_size - 1);
+        reinterpret_cast<void**>(addr)[-1] = raw;
+        return reinterpret_cast<void*>(addr);
+    }
+    static void operator delete(void* ptr) {
+        if (ptr) std::free(reinterpret_cast<void**>(ptr)[-1]);
+    }
+};
+
 // type trait
-struct normal {};    // normal task (for type inference)
-struct urgent {};    // urgent task (for type inference)
-struct sequence {};  // sequence tasks (for type inference)
+struct normal {};       // normal task (for type inference)
+struct urgent {};       // urgent task (for type inference)
+struct sequence {};     // sequence tasks (for type inference)
+struct noexception {};  // task never throws (for type inference)
 
 // function_: try to avoid heap allocation
 
-template<typename Signature, size_t InlineSize = 64 - sizeof(void*)>
+template<typename Signature, size_t InlineSize = 64 - 2 * sizeof(void*)>
 class function_;
 
 template<typename T>
@@ -49,57 +71,65 @@ struct is_function_<function_<R, N>> : std::true_type {};
 template<typename R, typename... Args, size_t InlineSize>
 class function_<R(Args...), InlineSize> {
 private:
-    struct callable_base {
-        virtual R invoke(Args&&...) = 0;
-        virtual void move_into(void* buffer) = 0;
-        virtual void clone_into(void* buffer) const = 0;
-        virtual ~callable_base() = default;
+    // static function table instead of virtual functions, nullptr means memcpy / nothing to do
+    struct vtable {
+        R (*invoke)(void* storage, Args&&... args);
+        void (*relocate)(void* dst, void* src);
+        void (*clone)(void* dst, const void* src);
+        void (*destroy)(void* storage);
     };
 
-    template<typename F>
-    struct callable_impl : callable_base {
-        F f;
+    static constexpr size_t storage_align = alignof(void*);
 
-        template<typename U>
-        callable_impl(U&& fn) : f(std::forward<U>(fn)) {}
+    template<typename F>
+    struct fits_inline : std::integral_constant<bool, sizeof(F) <= InlineSize && alignof(F) <= storage_align> {};
 
-        R invoke(Args&&... args) override {
-            return f(std::forward<Args>(args)...);
+    // callable stored in the buffer
+    template<typename F>
+    struct inline_ops {
+        static R invoke(void* storage, Args&&... args) {
+            return (*static_cast<F*>(storage))(std::forward<Args>(args)...);
+        }
+        static void relocate(void* dst, void* src) {
+            new (dst) F(std::move(*static_cast<F*>(src)));
+            static_cast<F*>(src)->~F();
         }
-        void move_into(void* buffer) override {
-            new (buffer) callable_impl(std::move(f));
+        static void clone(void* dst, const void* src) {
+            new (dst) F(*static_cast<const F*>(src));
         }
-        void clone_into(void* buffer) const override {
-            new (buffer) callable_impl(f);
+        static void destroy(void* storage) {
+            static_cast<F*>(storage)->~F();
+        }
+        static const vtable* table() {
+            // trivially copyable callables (function pointers, empty lambdas ...) are memcpy-ed
+            static const vtable vt = {
+                &invoke,
+                std::is_trivially_copyable<F>::value ? nullptr : &relocate,
+                std::is_trivially_copyable<F>::value ? nullptr : &clone,
+                std::is_trivially_destructible<F>::value ? nullptr : &destroy,
+            };
+            return &vt;
         }
     };
 
+    // pointer to the callable stored in the buffer, relocated by memcpy
     template<typename F>
-    struct heap_callable_impl : callable_base {
-        F* pf;
-
-        heap_callable_impl() : pf(nullptr) {} ;
-        template<typename U>
-        heap_callable_impl(U&& fn) : pf(new F(std::forward<U>(fn))) {}
-
-        heap_callable_impl(const heap_callable_impl&) = delete;
-        heap_callable_impl& operator=(const heap_callable_impl&) = delete;
-
-        heap_callable_impl(heap_callable_impl&&) = default;
-        heap_callable_impl& operator=(heap_callable_impl&&) = default;
-
-        ~heap_callable_impl() {  delete pf; }
-
-        R invoke(Args&&... args) override {
-            return (*pf)(std::forward<Args>(args)...);
+    struct heap_ops {
+        static F*& ptr(void* storage) {
+            return *static_cast<F**>(storage);
+        }
+        static R invoke(void* storage, Args&&... args) {
+            return (*ptr(storage))(std::forward<Args>(args)...);
+        }
+        static void clone(void* dst, const void* src) {
+            new (dst) F*(new F(**static_cast<F* const*>(src)));
         }
-        void move_into(void* buffer) override {
-            auto pc = new (buffer) heap_callable_impl();
-            pc->pf = pf;
-            pf = nullptr;
+        static void destroy(void* storage) {
+            delete ptr(storage);
         }
-        void clone_into(void* buffer) const override {
-            new (buffer) heap_callable_impl(*pf);
+        static const vtable* table() {
+            static const vtable vt = {&invoke, nullptr, &clone, &destroy};
+            return &vt;
         }
     };
 
@@ -109,43 +139,33 @@ public:
     function_() = default;
     function_(std::nullptr_t) {}
     function_(const function_& other) {
-        if (other.callable) {
-            other.callable->clone_into(buffer);
-            callable = reinterpret_cast<callable_base*>(&buffer);
-        }
+        copy_from(other);
     }
     function_(function_&& other) noexcept {
-        if (other.callable) {
-            other.callable->move_into(buffer);
-            callable = reinterpret_cast<callable_base*>(&buffer);
-            other.callable = nullptr;
-        }
+        move_from(other);
     }
     template<typename F,
         typename T = typename std::decay<F>::type,
         typename std::enable_if<!is_function_<T>::value, int>::type = 0,
-        typename std::enable_if<(sizeof(callable_impl<T>) > InlineSize), int>::type = 0>
+        typename std::enable_if<!fits_inline<T>::value, int>::type = 0>
     function_(F&& f) {
-        new (buffer) heap_callable_impl<T>(std::forward<F>(f));
-        callable = reinterpret_cast<callable_base*>(&buffer);
+        new (buffer) T*(new T(std::forward<F>(f)));
+        vt = heap_ops<T>::table();
     }
 
     template<typename F,
         typename T = typename std::decay<F>::type,
         typename std::enable_if<!is_function_<T>::value, int>::type = 0,
-        typename std::enable_if<(sizeof(callable_impl<T>) <= InlineSize), int>::type = 0>
+        typename std::enable_if<fits_inline<T>::value, int>::type = 0>
     function_(F&& f) {
-        new (buffer) callable_impl<T>(std::forward<F>(f));
-        callable = reinterpret_cast<callable_base*>(&buffer);
+        new (buffer) T(std::forward<F>(f));
+        vt = inline_ops<T>::table();
     }
 
     function_& operator=(const function_& other) {
         if (this != &other) {
             reset();
-            if (other.callable) {
-                other.callable->clone_into(buffer);
-                callable = reinterpret_cast<callable_base*>(&buffer);
-            }
+            copy_from(other);
         }
         return *this;
     }
@@ -153,11 +173,7 @@ public:
     function_& operator=(function_&& other) noexcept {
         if (this != &other) {
             reset();
-            if (other.callable) {
-                other.callable->move_into(buffer);
-                callable = reinterpret_cast<callable_base*>(&buffer);
-                other.callable = nullptr;
-            }
+            move_from(other);
         }
         return *this;
     }
@@ -167,31 +183,63 @@ public:
     }
 
     void reset() {
-        if (callable) {
-            callable->~callable_base();
-            callable = nullptr;
+        if (vt) {
+            if (vt->destroy) vt->destroy(buffer);
+            vt = nullptr;
         }
     }
 
     explicit operator bool() const {
-        return callable != nullptr;
+        return vt != nullptr;
     }
 
     R operator()(Args... args) const {
-        if (!callable)
+        if (!vt)
             throw std::bad_function_call();
-        return callable->invoke(std::forward<Args>(args)...);
+        return vt->invoke(buffer, std::forward<Args>(args)...);
     }
 
 private:
-    alignas(std::max_align_t) char buffer[InlineSize];
-    callable_base* callable = nullptr;
+    void copy_from(const function_& other) {
+        if (other.vt) {
+            if (other.vt->clone) {
+                other.vt->clone(buffer, other.buffer);
+            } else {
+                std::memcpy(buffer, other.buffer, InlineSize);
+            }
+            vt = other.vt;
+        }
+    }
+    void move_from(function_& other) noexcept {
+        if (other.vt) {
+            if (other.vt->relocate) {
+                other.vt->relocate(buffer, other.buffer);
+            } else {
+                std::memcpy(buffer, other.buffer, InlineSize);
+            }
+            vt = other.vt;
+            other.vt = nullptr;
+        }
+    }
+
+    alignas(storage_align) mutable unsigned char buffer[InlineSize];
+    const vtable* vt = nullptr;
 };
 
 
 // using task_t = std::function<void()>;
 using task_t = function_<void()>;
 
+// Compact task: a free function and its context (16 bytes in the task queue)
+struct raw_task {
+    void (*fn)(void*);
+    void* ctx;
+
+    void operator()() const {
+        fn(ctx);
+    }
+};
+
 /**
  * @brief std::future collector
  * @tparam T return type
@@ -1,91 +1,161 @@
 #pragma once
+#include <algorithm>
+#include <cassert>
+#include <chrono>
 #include <condition_variable>
 #include <cstdlib>
+#include <deque>
 #include <future>
 #include <iostream>
-#include <map>
 #include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
 #include <workspace/autothread.hpp>
+#include <workspace/coalesce.hpp>
+#include <workspace/edfqueue.hpp>
+#include <workspace/fairqueue.hpp>
+#include <workspace/metrics.hpp>
+#include <workspace/policy.hpp>
+#include <workspace/reactor.hpp>
 #include <workspace/taskqueue.hpp>
 #include <workspace/utility.hpp>
 
 namespace wsp {
+namespace details {
 
-enum class waitstrategy {
-    lowlatancy,  // Busy-wait with std::this_thread::yield(), minimal latency.
-    balance,     // Busy-wait initially, then sleep briefly after max_spin_count.
-    blocking     // Block thread using condition variables until a task is available
-                 // or conditions are met.
+// What a supervisor needs from a workbranch of any policies
+class branch_base {
+public:
+    virtual ~branch_base() = default;
+    virtual void add_worker() = 0;
+    virtual void del_worker() = 0;
+    virtual size_t num_workers() = 0;
+    virtual size_t num_tasks() = 0;
+    virtual branch_snapshot snapshot() const = 0;
+    // heartbeat epoch of every worker slot, by worker index
+    virtual void heartbeats(std::vector<uint64_t>& epochs) const = 0;
 };
 
-namespace details {
+// How a workbranch creates its workers
+struct worker_options {
+    bool lazy = false;      // spawn workers on demand, up to the number given to the constructor
+    size_t stack_size = 0;  // stack size of each worker (bytes), 0: system default
+};
 
-class workbranch {
-    using worker = autothread<detach>;
-    using worker_map = std::map<worker::id, worker>;
+/**
+ * @brief workbranch assembled from policies at compile time
+ * @tparam Queue task queue (taskqueue)
+ * @tparam Wait how idle workers wait (dynamic_wait, lowlatancy_wait, balance_wait, blocking_wait)
+ * @tparam Task runnable object stored in the queue (task_t)
+ * @tparam Exception how exceptions thrown by tasks are handled (log_exceptions, ignore_exceptions)
+ */
+template <template <typename> class Queue = taskqueue, typename Wait = dynamic_wait, typename Task = task_t,
+          typename Exception = log_exceptions>
+class basic_workbranch : public branch_base, public cache_aligned {
+    Wait wait_policy;
 
-    const int max_spin_count = 10000;
-    waitstrategy wait_strategy = {};
+    // read by every worker on every loop, written only by control operations
+    alignas(cacheline_size) std::atomic<size_t> decline{0};  // changed under "lok"
+    std::atomic<bool> is_waiting{false};
+    std::atomic<bool> destructing{false};
 
-    size_t decline = 0;
+    // guarded by "lok", written by the workers pausing in wait_tasks()
+    alignas(cacheline_size) std::mutex lok = {};
+    std::condition_variable thread_cv = {};
+    std::condition_variable task_done_cv = {};
+    std::condition_variable waiting_finished = {};
     size_t task_done_workers = 0;
     size_t waiting_finished_worker = 0;
-    bool is_waiting = false;
-    bool destructing = false;
+    size_t retiring = 0;  // workers running their mailboxes before leaving
+    size_t workers = 0;   // live workers, including the ones being started
 
-    worker_map workers = {};
-    taskqueue<task_t> tq = {};
+    // "sleepers" of the waiter is read by every submission
+    alignas(cacheline_size) waiter idle_waiter;
+    std::atomic<size_t> nworkers{0};
+    std::atomic<size_t> lazy_left{0};  // workers to spawn on demand
+    std::atomic<reactor*> io{nullptr};  // created by the first watch()
+    std::atomic<int> quiet_waiters{0};  // threads in wait_idle()
+    std::condition_variable quiet_cv;   // notified when a worker gets idle
+    const size_t stack_size = 0;
+    const bool lazy = false;
+    static constexpr size_t min_spawn_share = 8;  // workers started by each thread of spawn()
 
-    std::mutex lok = {};
-    std::condition_variable thread_cv = {};
-    std::condition_variable task_done_cv = {};
-    std::condition_variable task_cv = {};
-    std::condition_variable waiting_finished = {};
+    alignas(cacheline_size) Queue<Task> tq = {};
+    worker_slots slots;
+    coalescer<Task> batches;
+    error_sink esink;
+#if WSP_ENABLE_TRACE
+    std::atomic<unsigned> trace_every{1};
+    std::atomic<uint64_t> trace_ids{0};
+    std::atomic<uint64_t> trace_seen{0};  // submissions counted for sampling, by all producers
+#endif
 
 public:
     /**
      * @brief construct function
      * @param wks initial number of workers
-     * @param strategy wait_strategy for workers (defaults to lowlatancy).
+     * @param wait wait policy for workers, a waitstrategy for dynamic_wait (defaults to lowlatancy).
+     * @param opts how workers are created (lazily, stack size)
      */
-    explicit workbranch(int wks = 1, waitstrategy strategy = waitstrategy::lowlatancy) {
-        wait_strategy = strategy;
-        for (int i = 0; i < std::max(wks, 1); ++i) {
-            add_worker();  // worker
+    explicit basic_workbranch(int wks = 1, Wait wait = Wait(), worker_options opts = worker_options())
+      : wait_policy(wait)
+      , stack_size(opts.stack_size)
+      , lazy(opts.lazy) {
+        if (lazy) {
+            lazy_left.store(std::max(wks, 1));
+        } else {
+            spawn(std::max(wks, 1));
         }
     }
-    workbranch(const workbranch&) = delete;
-    workbranch(workbranch&&) = delete;
-    ~workbranch() {
+    basic_workbranch(const basic_workbranch&) = delete;
+    basic_workbranch(basic_workbranch&&) = delete;
+    ~basic_workbranch() {
         std::unique_lock<std::mutex> lock(lok);
-        decline = workers.size();
-        destructing = true;
-        if (wait_strategy == waitstrategy::blocking) task_cv.notify_all();
-        thread_cv.wait(lock, [this] { return !decline; });
+        decline.store(workers - retiring);
+        destructing.store(true);
+        wake_all();
+        thread_cv.wait(lock, [this] { return !decline.load(std::memory_order_relaxed) && !retiring; });
+        delete io.load();
     }
 
 public:
     /**
      * @brief add one worker
-     * @note O(logN)
+     * @note The thread is created outside the lock.
      */
-    void add_worker() {
-        std::lock_guard<std::mutex> lock(lok);
-        std::thread t(&workbranch::mission, this);
-        workers.emplace(t.get_id(), std::move(t));
+    void add_worker() override {
+        launch(reserve(1).front());
+    }
+
+    /**
+     * @brief add workers, creating their threads in parallel
+     * @param n number of workers to add
+     * @note A lazy workbranch only starts the workers it has yet to spawn (at most n),
+     * so it never grows past the number given to the constructor.
+     */
+    void prewarm(size_t n) {
+        if (lazy) {
+            auto left = lazy_left.load(std::memory_order_relaxed);
+            while (left && !lazy_left.compare_exchange_weak(left, left - std::min(left, n))) {
+            }
+            n = std::min(left, n);
+        }
+        if (n) spawn(n);
     }
 
     /**
      * @brief delete one worker
      * @note O(1)
      */
-    void del_worker() {
+    void del_worker() override {
         std::lock_guard<std::mutex> lock(lok);
-        if (workers.empty()) {
+        if (!workers) {
             throw std::runtime_error("workspace: No worker in workbranch to delete");
         } else {
-            decline++;
+            decline.store(decline.load(std::memory_order_relaxed) + 1);
         }
+        wake_all();  // the worker polling the reactor may be the one to leave
     }
 
     /**
@@ -96,66 +166,214 @@ public:
      * @return return true if all tasks done
      */
     bool wait_tasks(unsigned timeout = -1) {
+        flush();
         bool res;
         {
             std::unique_lock<std::mutex> locker(lok);
-            is_waiting = true;  // task_done_workers == 0
-            if (wait_strategy == waitstrategy::blocking) task_cv.notify_all();
+            is_waiting.store(true);  // task_done_workers == 0
+            wake_all();
             res = task_done_cv.wait_for(locker, std::chrono::milliseconds(timeout), [this] {
-                return task_done_workers >= workers.size();  // use ">=" to avoid supervisor delete workers
+                return task_done_workers >= workers;  // use ">=" to avoid supervisor delete workers
             });
             task_done_workers = 0;
-            is_waiting = false;
+            is_waiting.store(false);
         }
         thread_cv.notify_all();  // recover
 
         std::unique_lock<std::mutex> locker(lok);
         waiting_finished.wait(locker, [this] {
-            return waiting_finished_worker >= workers.size();
+            return waiting_finished_worker >= workers;
         });
         waiting_finished_worker = 0;
         return res;
     }
 
+    /**
+     * @brief Wait until the workbranch has nothing to do, without pausing the workers.
+     * @param deadline the latest time to return
+     * @return true if all tasks (including the ones submitted by tasks) are done
+     * @note Coalesced batches are published first. Handlers of watched fds are not waited for.
+     */
+    bool wait_idle(std::chrono::steady_clock::time_point deadline) {
+        flush();
+        quiet_waiters.fetch_add(1);
+        std::unique_lock<std::mutex> locker(lok);
+        bool res = is_idle();
+        while (!res && std::chrono::steady_clock::now() < deadline) {
+            auto recheck = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);  // in case of a missed notice
+            quiet_cv.wait_until(locker, std::min(deadline, recheck));
+            res = is_idle();
+        }
+        quiet_waiters.fetch_sub(1);
+        return res;
+    }
+    /**
+     * @brief Check whether no task is queued, posted to a worker or running.
+     * @return true if idle
+     */
+    bool is_idle() {
+        uint64_t done = 0;
+        slots.for_each([&](const worker_slot& slot) { done += slot.stats.settled.load(std::memory_order_acquire); });
+        if (tq.length() || batches.holding()) return false;
+        uint64_t taken = tq.popped() - dropped(tq, 0);
+        bool posted = false;
+        slots.for_each([&](const worker_slot& slot) {
+            taken += slot.mail.taken();
+            posted = posted || slot.mail.size();
+        });
+        return done == taken && !posted;
+    }
+
 public:
     /**
      * @brief get number of workers
      * @return number
      */
-    size_t num_workers() {
+    size_t num_workers() override {
         std::lock_guard<std::mutex> lock(lok);
-        return workers.size();
+        return workers;
     }
     /**
      * @brief get number of tasks in the task queue
      * @return number
      */
-    size_t num_tasks() {
+    size_t num_tasks() override {
         return tq.length();
     }
+    /**
+     * @brief collect the counters of the workbranch without locking
+     * @return branch_snapshot
+     * @note The counters are relaxed, the result is approximate while tasks are running.
+     */
+    branch_snapshot snapshot() const override {
+        branch_snapshot snap;
+        auto now = now_ns();
+        slots.for_each([&](const worker_slot& slot) { slot.stats.collect(snap, now); });
+        auto popped = tq.popped();
+        snap.urgent = tq.pushed_front();
+        snap.submitted = tq.pushed_back() + snap.urgent;
+        snap.tasks = snap.submitted > popped ? snap.submitted - popped : 0;
+        snap.workers = nworkers.load(std::memory_order_relaxed);
+        snap.declining = std::min<uint64_t>(decline.load(std::memory_order_relaxed), snap.workers);
+        return snap;
+    }
+    /**
+     * @brief collect the heartbeat epoch of every worker slot without locking
+     * @param epochs epochs by worker index (odd while the worker is running a task,
+     * the task being the (epoch / 2)th task of the slot)
+     */
+    void heartbeats(std::vector<uint64_t>& epochs) const override {
+        epochs.clear();
+        slots.for_each([&](const worker_slot& slot) { epochs.push_back(slot.stats.epoch.load(std::memory_order_relaxed)); });
+    }
+
+    /**
+     * @brief pack consecutive normal tasks of each producer thread into batches
+     * @param batch max tasks of a batch (0 or 1 disables coalescing)
+     * @param window_us max time (microseconds) the first task of a batch waits for others
+     * @note A batch counts as one task in the counters. The window is checked by the next
+     * submission and by idle workers (blocking ones park until the oldest batch is due);
+     * flush() and wait_tasks() publish all batches at once.
+     */
+    void set_coalescing(size_t batch, unsigned window_us = 100) {
+        flush();
+        batches.configure(batch, window_us);
+    }
+    /**
+     * @brief publish the tasks held by coalescing batches
+     */
+    void flush() {
+        batches.flush([this](std::vector<Task>&& tasks) { publish(std::move(tasks)); });
+    }
+
+    /**
+     * @brief run the handler on a worker whenever the fd is ready
+     * @param fd file descriptor (non-blocking, owned by the caller)
+     * @param events epoll events such as EPOLLIN
+     * @param handler callable as handler(int fd, uint32_t events)
+     * @note Linux only. Idle workers take turns to wait in epoll_wait() instead of their
+     * wait policy, the fd is watched again after its handler returns.
+     */
+    void watch(int fd, uint32_t events, reactor::handler_t handler) {
+        auto r = io.load();
+        if (!r) {
+            std::lock_guard<std::mutex> lock(lok);
+            r = io.load();
+            if (!r) {
+                r = new reactor;
+                io.store(r);
+            }
+        }
+        r->watch(fd, events, std::move(handler));
+        wake_all();  // an idle worker becomes the poller
+    }
+    /**
+     * @brief stop running the handler of the fd
+     * @param fd file descriptor
+     */
+    void unwatch(int fd) {
+        if (auto r = io.load()) r->unwatch(fd);
+    }
+
+    /**
+     * @brief trace one of every "every" submitted tasks
+     * @param every sampling interval (0 stops tracing)
+     * @note No effect unless WSP_ENABLE_TRACE is defined to 1.
+     */
+    void set_trace_sampling(unsigned every) {
+#if WSP_ENABLE_TRACE
+        trace_every.store(every, std::memory_order_relaxed);
+#else
+        (void)every;
+#endif
+    }
+    /**
+     * @brief export the traced tasks in Chrome trace JSON (can be opened by Perfetto)
+     * @param os output stream
+     * @param pid process id shown in the trace (to tell workbranches apart)
+     */
+    void export_trace(std::ostream& os, int pid = 0) const {
+        std::vector<trace_event> events;
+#if WSP_ENABLE_TRACE
+        slots.for_each([&](const worker_slot& slot) { slot.trace.ring.collect(events, slot.index); });
+#endif
+        write_chrome_trace(os, events, pid);
+    }
+    /**
+     * @brief get the histogram of queue waiting time (enqueue -> start) of the traced tasks
+     * @return histogram (ns)
+     */
+    histogram wait_histogram() const {
+        histogram h;
+#if WSP_ENABLE_TRACE
+        slots.for_each([&](const worker_slot& slot) { slot.trace.wait.collect(h); });
+#endif
+        return h;
+    }
+    /**
+     * @brief get the histogram of running time (start -> end) of the traced tasks
+     * @return histogram (ns)
+     */
+    histogram run_histogram() const {
+        histogram h;
+#if WSP_ENABLE_TRACE
+        slots.for_each([&](const worker_slot& slot) { slot.trace.run.collect(h); });
+#endif
+        return h;
+    }
 
 public:
     /**
      * @brief async execute the task
-     * @param task runnable object (normal)
+     * @param task runnable object (normal or noexcept)
      * @return void
+     * @note The task is stored as is, exceptions are handled by the worker.
      */
     template <typename T = normal, typename F, typename R = details::result_of_t<F>,
               typename DR = typename std::enable_if<std::is_void<R>::value>::type>
-    auto submit(F&& task) -> typename std::enable_if<std::is_same<T, normal>::value>::type {
-        tq.push_back([task] {
-            try {
-                task();
-            } catch (const std::exception& ex) {
-                std::cerr << "workspace: worker[" << std::this_thread::get_id()
-                          << "] caught exception:\n  what(): " << ex.what() << '\n'
-                          << std::flush;
-            } catch (...) {
-                std::cerr << "workspace: worker[" << std::this_thread::get_id() << "] caught unknown exception\n"
-                          << std::flush;
-            }
-        });  // function
-        if (wait_strategy == waitstrategy::blocking) task_cv.notify_one();
+    auto submit(F&& task) -> typename std::enable_if<std::is_same<T, normal>::value ||
+                                                     std::is_same<T, noexception>::value>::type {
+        enqueue_back(std::forward<F>(task));
     }
 
     /**
@@ -166,19 +384,7 @@ public:
     template <typename T, typename F, typename R = details::result_of_t<F>,
               typename DR = typename std::enable_if<std::is_void<R>::value>::type>
     auto submit(F&& task) -> typename std::enable_if<std::is_same<T, urgent>::value>::type {
-        tq.push_front([task] {
-            try {
-                task();
-            } catch (const std::exception& ex) {
-                std::cerr << "workspace: worker[" << std::this_thread::get_id()
-                          << "] caught exception:\n  what(): " << ex.what() << '\n'
-                          << std::flush;
-            } catch (...) {
-                std::cerr << "workspace: worker[" << std::this_thread::get_id() << "] caught unknown exception\n"
-                          << std::flush;
-            }
-        });
-        if (wait_strategy == waitstrategy::blocking) task_cv.notify_one();
+        enqueue_front(std::forward<F>(task));
     }
 
     /**
@@ -189,19 +395,181 @@ public:
      */
     template <typename T, typename F, typename... Fs>
     auto submit(F&& task, Fs&&... tasks) -> typename std::enable_if<std::is_same<T, sequence>::value>::type {
-        tq.push_back([=] {
-            try {
-                this->rexec(task, tasks...);
-            } catch (const std::exception& ex) {
-                std::cerr << "workspace: worker[" << std::this_thread::get_id()
-                          << "] caught exception:\n  what(): " << ex.what() << '\n'
-                          << std::flush;
-            } catch (...) {
-                std::cerr << "workspace: worker[" << std::this_thread::get_id() << "] caught unknown exception\n"
-                          << std::flush;
-            }
+        enqueue_back([=] { rexec(task, tasks...); });
+    }
+
+    /**
+     * @brief async execute a runtime-sized sequence of tasks
+     * @param first begin of the tasks
+     * @param last end of the tasks
+     * @return void
+     * @note The tasks are copied into one task and executed in order by one worker.
+     */
+    template <typename Iter>
+    void submit_seq(Iter first, Iter last) {
+        using D = typename std::decay<decltype(*first)>::type;
+        std::vector<D> tasks(first, last);
+        if (!tasks.empty()) enqueue_back(sequence_task<D>{std::move(tasks)});
+    }
+
+    /**
+     * @brief async execute a runtime-sized sequence of tasks
+     * @param tasks container of runnable objects (moved in if it is a std::vector rvalue)
+     * @return void
+     */
+    template <typename Range>
+    auto submit_seq(const Range& tasks) -> decltype(std::begin(tasks), void()) {
+        submit_seq(std::begin(tasks), std::end(tasks));
+    }
+    template <typename F>
+    void submit_seq(std::vector<F>&& tasks) {
+        if (!tasks.empty()) enqueue_back(sequence_task<F>{std::move(tasks)});
+    }
+
+    /**
+     * @brief execute the task once on each current worker
+     * @param task runnable object (copied for each worker)
+     * @return std::future<void> ready when every worker has run it (holds the first exception thrown)
+     * @note Runs after the task that each worker is running, before its next queued task.
+     */
+    template <typename F>
+    std::future<void> broadcast(F&& task) {
+        using D = typename std::decay<F>::type;
+        auto done = std::make_shared<broadcast_state>();
+        D copy(std::forward<F>(task));
+        std::lock_guard<std::mutex> lock(lok);
+        std::vector<worker_slot*> targets;
+        slots.for_each([&](worker_slot& slot) {
+            if (slot.in_use.load(std::memory_order_relaxed) && slot.mail.is_open()) targets.push_back(&slot);
         });
-        if (wait_strategy == waitstrategy::blocking) task_cv.notify_one();
+        done->left.store(targets.size());
+        for (auto slot : targets) slot->mail.post(broadcast_task<D>{copy, done});  // cannot fail under "lok"
+        if (targets.empty()) done->promise.set_value();
+        wake_all();
+        return done->promise.get_future();
+    }
+
+    /**
+     * @brief async execute the task on the worker of the index
+     * @param index index of the worker in [0, num_workers()) while no worker is leaving
+     * @param task runnable object
+     * @return void
+     * @note Throws std::runtime_error if there is no such worker. A leaving worker runs its
+     * mailbox before it exits.
+     */
+    template <typename F>
+    void submit_to(size_t index, F&& task) {
+        auto slot = slots.at(index);
+        if (!slot || !slot->in_use.load(std::memory_order_relaxed) || !slot->mail.post(task_t(std::forward<F>(task)))) {
+            throw std::runtime_error("workspace: No worker with index " + std::to_string(index));
+        }
+        wake_all();
+    }
+
+    /**
+     * @brief async execute fn(ctx)
+     * @param fn free function
+     * @param ctx context passed to fn (owned by the caller)
+     * @return void
+     * @note The task takes 16 bytes in the task queue instead of a whole task_t.
+     * A null fn is rejected (std::runtime_error).
+     */
+    template <typename T = normal>
+    auto submit_raw(void (*fn)(void*), void* ctx) -> typename std::enable_if<std::is_same<T, normal>::value ||
+                                                                             std::is_same<T, noexception>::value>::type {
+        enqueue_back(checked_raw(fn, ctx));
+    }
+
+    /**
+     * @brief async execute fn(ctx) as soon as possible
+     * @param fn free function
+     * @param ctx context passed to fn (owned by the caller)
+     * @return void
+     */
+    template <typename T>
+    auto submit_raw(void (*fn)(void*), void* ctx) -> typename std::enable_if<std::is_same<T, urgent>::value>::type {
+        enqueue_front(checked_raw(fn, ctx));
+    }
+
+    /**
+     * @brief async execute the task on behalf of a tenant
+     * @param tenant tenant id
+     * @param task runnable object returning void
+     * @return false if the tenant already has max_depth tasks queued
+     * @note Needs a queue policy with tenants (wsp::policy::fairqueue). The task is not coalesced.
+     */
+    template <typename F>
+    bool submit_as(uint32_t tenant, F&& task) {
+        bool accepted;
+#if WSP_ENABLE_TRACE
+        if (sampled()) {
+            accepted = tq.push_back_as(tenant, traced(std::forward<F>(task)));
+        } else
+#endif
+        {
+            accepted = tq.push_back_as(tenant, std::forward<F>(task));
+        }
+        if (accepted) pushed();
+        return accepted;
+    }
+    /**
+     * @brief set the share of a tenant
+     * @param tenant tenant id
+     * @param weight tasks taken from the tenant per round
+     * @param max_depth max tasks queued by the tenant (0: unlimited)
+     */
+    void set_tenant(uint32_t tenant, unsigned weight, size_t max_depth = 0) {
+        tq.set_tenant(tenant, weight, max_depth);
+    }
+    /**
+     * @brief get the counters of a tenant
+     * @param tenant tenant id
+     * @return tenant_stats
+     */
+    tenant_stats tenant_snapshot(uint32_t tenant) {
+        return tq.stats_of(tenant);
+    }
+
+    /**
+     * @brief async execute the task before the deadline
+     * @param deadline when the task should be done
+     * @param task runnable object returning void
+     * @note Needs a queue policy ordered by deadline (wsp::policy::edfqueue). The task is not coalesced.
+     */
+    template <typename F>
+    void submit_by(std::chrono::steady_clock::time_point deadline, F&& task) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+        auto at = ns > 0 ? static_cast<uint64_t>(ns) : 1;
+#if WSP_ENABLE_TRACE
+        if (sampled()) {
+            tq.push_by(at, traced(std::forward<F>(task)));
+        } else
+#endif
+        {
+            tq.push_by(at, std::forward<F>(task));
+        }
+        pushed();
+    }
+    /**
+     * @brief set the deadline of the tasks submitted without one
+     * @param after time after the submission
+     */
+    void set_default_deadline(std::chrono::nanoseconds after) {
+        tq.set_default_deadline(static_cast<uint64_t>(after.count()));
+    }
+    /**
+     * @brief discard the tasks whose deadline passed before a worker took them
+     * @param on whether to discard them (a dropped task with a future breaks its promise)
+     */
+    void set_drop_expired(bool on) {
+        tq.set_drop_expired(on);
+    }
+    /**
+     * @brief get the deadline counters (misses, dropped, steals)
+     * @return deadline_stats
+     */
+    deadline_stats deadline_snapshot() const {
+        return tq.deadlines();
     }
 
     /**
@@ -213,25 +581,9 @@ public:
               typename DR = typename std::enable_if<!std::is_void<R>::value, R>::type>
     auto submit(F&& task, typename std::enable_if<std::is_same<T, normal>::value, normal>::type = {})
         -> std::future<R> {
-        std::function<R()> exec(std::forward<F>(task));
+        using D = typename std::decay<F>::type;
         std::shared_ptr<std::promise<R>> task_promise = std::make_shared<std::promise<R>>();
-        tq.push_back([exec, task_promise] {
-            try {
-                task_promise->set_value(exec());
-            } catch (...) {
-                try {
-                    task_promise->set_exception(std::current_exception());
-                } catch (const std::exception& ex) {
-                    std::cerr << "workspace: worker[" << std::this_thread::get_id()
-                              << "] caught exception:\n  what(): " << ex.what() << '\n'
-                              << std::flush;
-                } catch (...) {
-                    std::cerr << "workspace: worker[" << std::this_thread::get_id() << "] caught unknown exception\n"
-                              << std::flush;
-                }
-            }
-        });
-        if (wait_strategy == waitstrategy::blocking) task_cv.notify_one();
+        enqueue_back(promised_task<D, R, !noexcept(std::declval<D&>()())>{std::forward<F>(task), task_promise});
         return task_promise->get_future();
     }
 
@@ -244,77 +596,439 @@ public:
               typename DR = typename std::enable_if<!std::is_void<R>::value, R>::type>
     auto submit(F&& task, typename std::enable_if<std::is_same<T, urgent>::value, urgent>::type = {})
         -> std::future<R> {
-        std::function<R()> exec(std::forward<F>(task));
+        using D = typename std::decay<F>::type;
+        std::shared_ptr<std::promise<R>> task_promise = std::make_shared<std::promise<R>>();
+        enqueue_front(promised_task<D, R, !noexcept(std::declval<D&>()())>{std::forward<F>(task), task_promise});
+        return task_promise->get_future();
+    }
+
+    /**
+     * @brief async execute the task which never throws
+     * @param task runnable object (noexcept)
+     * @return std::future<R>
+     * @note The future is not given the exception: no try/catch is added around the task.
+     * With log_exceptions (default) the worker catches and reports it, and the future gets
+     * std::future_error(broken_promise); with ignore_exceptions it terminates the program.
+     */
+    template <typename T, typename F, typename R = details::result_of_t<F>,
+              typename DR = typename std::enable_if<!std::is_void<R>::value, R>::type>
+    auto submit(F&& task, typename std::enable_if<std::is_same<T, noexception>::value, noexception>::type = {})
+        -> std::future<R> {
+        using D = typename std::decay<F>::type;
         std::shared_ptr<std::promise<R>> task_promise = std::make_shared<std::promise<R>>();
-        tq.push_front([exec, task_promise] {
+        enqueue_back(promised_task<D, R, false>{std::forward<F>(task), task_promise});
+        return task_promise->get_future();
+    }
+
+    /**
+     * @brief handle the exceptions thrown by tasks with a callback instead of the default ring
+     * @param cb callback called on the worker thread
+     * @note Set it before submitting tasks.
+     */
+    void set_error_handler(error_sink::handler_t cb) {
+        esink.set_handler(std::move(cb));
+    }
+    /**
+     * @brief get the error sink (counters and draining of the default ring)
+     * @return reference of the error sink
+     */
+    error_sink& errors() {
+        return esink;
+    }
+
+private:
+    // shared by the copies of a broadcast task
+    struct broadcast_state {
+        std::atomic<size_t> left{0};
+        std::atomic<bool> failed{false};
+        std::promise<void> promise;
+    };
+
+    template <typename F>
+    struct broadcast_task {
+        F task;
+        std::shared_ptr<broadcast_state> state;
+
+        void operator()() {
             try {
-                task_promise->set_value(exec());
+                task();
             } catch (...) {
+                count_exception();
+                if (!state->failed.exchange(true)) state->promise.set_exception(std::current_exception());
+            }
+            if (state->left.fetch_sub(1) == 1 && !state->failed.load()) state->promise.set_value();
+        }
+    };
+
+    // value-returning task, the result or the exception goes to the promise
+    template <typename F, typename R, bool Catch>
+    struct promised_task {
+        F task;
+        std::shared_ptr<std::promise<R>> promise;
+
+        void operator()() {
+            run(std::integral_constant<bool, Catch>());
+        }
+        void run(std::true_type) {
+            try {
+                promise->set_value(task());
+            } catch (...) {
+                count_exception();
+                promise->set_exception(std::current_exception());
+            }
+        }
+        void run(std::false_type) {
+            promise->set_value(task());
+        }
+    };
+
+    // runtime-sized sequence, a throwing task stops the rest
+    template <typename F>
+    struct sequence_task {
+        std::vector<F> tasks;
+
+        void operator()() {
+            for (auto& each : tasks) each();
+        }
+    };
+
+    // tasks packed by the coalescer, each runs under the exception policy
+    struct batch_task {
+        std::vector<Task> tasks;
+        error_sink* sink;
+
+        void operator()() {
+            for (auto& each : tasks) Exception::invoke(each, *sink);
+        }
+    };
+
+#if WSP_ENABLE_TRACE
+    // task with its enqueue time, records the timestamps after running
+    template <typename F>
+    struct traced_task {
+        F task;
+        uint64_t id;
+        uint64_t enqueue;
+
+        void operator()() {
+            struct recorder {
+                const traced_task* self;
+                uint64_t start;
+                ~recorder() {
+                    if (auto slot = this_slot()) {
+                        slot->trace.record(self->id, self->enqueue, this_dequeue_ns(), start, now_ns());
+                    }
+                }
+            } rec = {this, now_ns()};  // also recorded when the task throws
+            task();
+        }
+    };
+
+    // one of every "trace_every" submissions to this workbranch
+    bool sampled() {
+        auto every = trace_every.load(std::memory_order_relaxed);
+        return every && (trace_seen.fetch_add(1, std::memory_order_relaxed) + 1) % every == 0;
+    }
+
+    template <typename F>
+    traced_task<typename std::decay<F>::type> traced(F&& task) {
+        return {std::forward<F>(task), trace_ids.fetch_add(1, std::memory_order_relaxed), now_ns()};
+    }
+#endif
+
+    static raw_task checked_raw(void (*fn)(void*), void* ctx) {
+        assert(fn != nullptr);
+        if (!fn) throw std::runtime_error("workspace: submit_raw with a null function");
+        return raw_task{fn, ctx};
+    }
+
+    template <typename F>
+    void enqueue_back(F&& task) {
+#if WSP_ENABLE_TRACE
+        if (sampled()) {
+            push_back(traced(std::forward<F>(task)));
+        } else
+#endif
+        {
+            push_back(std::forward<F>(task));
+        }
+    }
+
+    template <typename F>
+    void push_back(F&& task) {
+        if (batches.enabled()) {
+            auto held = batches.add(Task(std::forward<F>(task)),
+                                    [this](std::vector<Task>&& tasks) { publish(std::move(tasks)); });
+            if (held) wake_one();  // a parked worker publishes the batch when it is due
+        } else {
+            tq.push_back(std::forward<F>(task));
+            pushed();
+        }
+    }
+
+    void publish(std::vector<Task>&& tasks) {
+        if (tasks.size() == 1) {
+            tq.push_back(std::move(tasks.front()));
+        } else {
+            tq.push_back(batch_task{std::move(tasks), &esink});
+        }
+        pushed();
+    }
+
+    void wake_one() {
+        wait_policy.notify_one(idle_waiter);
+        if (auto r = io.load(std::memory_order_acquire)) r->interrupt();
+    }
+    void wake_all() {
+        wait_policy.notify_all(idle_waiter);
+        if (auto r = io.load(std::memory_order_acquire)) r->interrupt();
+    }
+
+    // wait for ready fds while idle, false if another worker is polling
+    bool poll_io(reactor* r, worker_slot* slot, int& spin_count, std::vector<reactor::ready>& ready) {
+        auto& stats = slot->stats;
+        auto timeout = wait_policy.poll_timeout(spin_count);
+        if (timeout && batches.holding()) {  // come back when the oldest batch is due
+            auto due = static_cast<int>((batches.due_in() + 999999) / 1000000);
+            if (timeout < 0 || due < timeout) timeout = due;
+        }
+        bool polled = r->poll(ready, timeout, [this, slot] { return !wakeable(slot); });
+        if (!polled) return false;
+        if (timeout) {
+            bump(stats.parks);
+        } else {
+            bump(stats.spins);
+        }
+        if (ready.empty() && !wakeable(slot)) return true;
+        wait_policy.notify_one(idle_waiter);  // hand the reactor to another idle worker
+        if (ready.empty()) return true;
+        stats.begin_busy();
+        for (auto& each : ready) {
+            auto handler = each.handler;
+            auto fd = each.fd;
+            auto events = each.events;
+            execute(slot, [handler, fd, events] { (*handler)(fd, events); });
+            r->rearm(each);
+        }
+        ready.clear();
+        spin_count = 0;
+        return true;
+    }
+
+    // something for an idle worker to do
+    bool wakeable(worker_slot* slot) {
+        return tq.length() > 0 || slot->mail.size() > 0 || is_waiting.load() || destructing.load() ||
+               decline.load() > 0;
+    }
+
+    // wake a worker, or spawn one if the branch is lazy and the workers are all busy
+    void pushed() {
+        wake_one();
+        if (lazy_left.load(std::memory_order_relaxed)) {
+            auto live = nworkers.load(std::memory_order_relaxed);
+            auto in = tq.pushed_back() + tq.pushed_front();
+            auto out = tq.popped();
+            if (live && (in <= out || in - out <= live)) return;
+            auto left = lazy_left.load(std::memory_order_relaxed);
+            while (left && !lazy_left.compare_exchange_weak(left, left - 1)) {
+            }
+            if (left) add_worker();
+        }
+    }
+
+    // count new workers and take their slots
+    std::vector<worker_slot*> reserve(size_t n) {
+        std::vector<worker_slot*> targets;
+        targets.reserve(n);
+        std::lock_guard<std::mutex> lock(lok);
+        for (size_t i = 0; i < n; ++i) {
+            auto slot = slots.acquire();
+            slot->mail.open();
+            targets.push_back(slot);
+        }
+        workers += n;
+        nworkers.store(workers, std::memory_order_relaxed);
+        return targets;
+    }
+
+    // add n workers, creating their threads in parallel
+    void spawn(size_t n) {
+        auto targets = reserve(n);
+        size_t helpers = std::min<size_t>(n / min_spawn_share, std::thread::hardware_concurrency());
+        if (helpers <= 1) {
+            for (auto slot : targets) launch(slot);
+            return;
+        }
+        // each helper starts a share of the workers, the caller starts the first share
+        std::exception_ptr failed;
+        std::mutex failed_lok;
+        auto start = [&](size_t from, size_t to) {
+            for (size_t i = from; i < to; ++i) {
                 try {
-                    task_promise->set_exception(std::current_exception());
-                } catch (const std::exception& ex) {
-                    std::cerr << "workspace: worker[" << std::this_thread::get_id()
-                              << "] caught exception:\n  what(): " << ex.what() << '\n'
-                              << std::flush;
+                    launch(targets[i]);
                 } catch (...) {
-                    std::cerr << "workspace: worker[" << std::this_thread::get_id() << "] caught unknown exception\n"
-                              << std::flush;
+                    std::lock_guard<std::mutex> lock(failed_lok);
+                    if (!failed) failed = std::current_exception();
                 }
             }
-        });
-        if (wait_strategy == waitstrategy::blocking) task_cv.notify_one();
-        return task_promise->get_future();
+        };
+        std::vector<std::thread> spawners;
+        size_t share = (n + helpers - 1) / helpers;
+        for (size_t from = share; from < n; from += share) {
+            spawners.emplace_back(start, from, std::min(from + share, n));
+        }
+        start(0, share);
+        for (auto& each : spawners) each.join();
+        if (failed) std::rethrow_exception(failed);
+    }
+
+    // start the thread of a reserved worker, give the reservation back if failed
+    void launch(worker_slot* slot) {
+        try {
+            spawn_detached([this, slot] { mission(slot); }, stack_size);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(lok);
+            std::deque<task_t> rest;
+            slot->mail.close(rest);
+            slots.release(slot);
+            workers--;
+            nworkers.store(workers, std::memory_order_relaxed);
+            if (decline.load(std::memory_order_relaxed) > workers - retiring) decline.store(workers - retiring);
+            throw;
+        }
+    }
+
+    template <typename F>
+    void enqueue_front(F&& task) {
+#if WSP_ENABLE_TRACE
+        if (sampled()) {
+            tq.push_front(traced(std::forward<F>(task)));
+        } else
+#endif
+        {
+            tq.push_front(std::forward<F>(task));
+        }
+        pushed();
+    }
+
+    // busy CPU time is sampled after the 1st, 2nd, 4th ... 64th task, then every 64 tasks
+    static constexpr uint64_t cpu_sample_tasks = 64;
+
+    // tasks discarded by the queue instead of being run (edfqueue)
+    template <typename Q>
+    static auto dropped(const Q& q, int) -> decltype(q.deadlines().dropped) {
+        return q.deadlines().dropped;
+    }
+    template <typename Q>
+    static uint64_t dropped(const Q&, long) {
+        return 0;
+    }
+
+    // run a task on the worker of the slot
+    template <typename F>
+    void execute(worker_slot* slot, F&& task) {
+        auto& stats = slot->stats;
+        bump(stats.epoch);  // odd: running
+        Exception::invoke(task, esink);
+        bump(stats.epoch);
+        slot->context.after_task();
+        bump(stats.executed);
+        auto n = stats.executed.load(std::memory_order_relaxed);
+        if (n < cpu_sample_tasks ? !(n & (n - 1)) : !(n % cpu_sample_tasks)) stats.sample_busy();
     }
 
-private:
     // thread's default loop
-    void mission() {
-        task_t task;
+    void mission(worker_slot* slot) {
+        Task task;
+        task_t mail;
+        std::vector<reactor::ready> ready;
         int spin_count = 0;
+        auto& stats = slot->stats;
+        auto& context = slot->context;
+        this_slot() = slot;
+        context.enter(slot->index);
+        stats.start();
 
         while (true) {
-            if (decline <= 0 && tq.try_pop(task)) {
-                task();
+            if (slot->mail.try_pop(mail)) {  // tasks for this worker first
+                stats.begin_busy();
+                execute(slot, mail);
+                mail = task_t();  // release the captures (and a promise) at once
+                stats.settle();
+                spin_count = 0;
+                continue;
+            }
+            if (!decline.load(std::memory_order_acquire) && tq.try_pop(task)) {
+#if WSP_ENABLE_TRACE
+                if (trace_every.load(std::memory_order_relaxed)) this_dequeue_ns() = now_ns();
+#endif
+                stats.begin_busy();
+                execute(slot, task);
+                task = Task();
+                stats.settle();
                 spin_count = 0;
-            } else if (decline > 0) {
+                continue;
+            }
+            if (stats.end_busy() && quiet_waiters.load()) {  // only when this worker just got idle
                 std::lock_guard<std::mutex> lock(lok);
-                if (decline > 0 && decline--) {  // double check
-                    workers.erase(std::this_thread::get_id());
-                    if (is_waiting) task_done_cv.notify_one();
-                    if (destructing) thread_cv.notify_one();
+                quiet_cv.notify_all();
+            }
+            if (batches.enabled()) {
+                batches.sweep([this](std::vector<Task>&& tasks) { publish(std::move(tasks)); });
+            }
+            if (decline.load(std::memory_order_acquire)) {
+                std::unique_lock<std::mutex> lock(lok);
+                auto n = decline.load(std::memory_order_relaxed);
+                if (n > 0) {  // double check
+                    decline.store(n - 1, std::memory_order_relaxed);
+                    retiring++;
+                    std::deque<task_t> rest;
+                    slot->mail.close(rest);
+                    // user code runs outside the lock, "retiring" keeps the branch alive meanwhile
+                    lock.unlock();
+                    if (!rest.empty()) {  // run the tasks posted to this worker before leaving
+                        stats.begin_busy();
+                        for (auto& each : rest) {
+                            execute(slot, each);
+                            stats.settle();
+                        }
+                        stats.end_busy();
+                    }
+                    context.leave();  // destroys the per-worker objects
+                    lock.lock();
+                    if (!rest.empty() && quiet_waiters.load()) quiet_cv.notify_all();
+                    retiring--;
+                    workers--;
+                    nworkers.store(workers, std::memory_order_relaxed);
+                    slots.release(slot);
+                    this_slot() = nullptr;
+                    if (is_waiting.load(std::memory_order_relaxed)) task_done_cv.notify_one();
+                    waiting_finished.notify_one();
+                    if (destructing.load(std::memory_order_relaxed)) thread_cv.notify_one();
                     return;
                 }
             } else {
-                if (is_waiting) {
+                if (is_waiting.load(std::memory_order_acquire)) {
+                    bump(stats.parks);
                     std::unique_lock<std::mutex> locker(lok);
                     task_done_workers++;
                     task_done_cv.notify_one();
-                    thread_cv.wait(locker, [this] { return !is_waiting; });
+                    thread_cv.wait(locker, [this] { return !is_waiting.load(std::memory_order_relaxed); });
                     waiting_finished_worker ++;
-                    if (waiting_finished_worker >= workers.size())
+                    if (waiting_finished_worker >= workers)
                         waiting_finished.notify_one();
-                } else {
-                    switch (wait_strategy) {
-                        case waitstrategy::lowlatancy: {
-                            std::this_thread::yield();
-                            break;
-                        }
-                        case waitstrategy::balance: {
-                            if (spin_count < max_spin_count) {
-                                ++spin_count;
-                                std::this_thread::yield();
-                            } else {
-                                // Just tell the system to suspend this thread in the shortest time
-                                std::this_thread::sleep_for(std::chrono::nanoseconds(1));
-                            }
-                            break;
-                        }
-                        case waitstrategy::blocking: {
-                            std::unique_lock<std::mutex> locker(lok);
-                            task_cv.wait(locker, [this] { return num_tasks() > 0 || is_waiting || destructing; });
-                            break;
-                        }
+                } else if (auto r = io.load(std::memory_order_acquire)) {
+                    if (!poll_io(r, slot, spin_count, ready)) {
+                        wait_policy.idle(idle_waiter, stats, spin_count,
+                                         [this, slot, r] { return wakeable(slot) || r->vacant(); });
                     }
+                } else if (batches.holding()) {  // park until the oldest batch is due
+                    wait_policy.idle_for(idle_waiter, stats, spin_count, batches.due_in(),
+                                         [this, slot] { return wakeable(slot) || io.load() != nullptr; });
+                } else {
+                    wait_policy.idle(idle_waiter, stats, spin_count, [this, slot] {
+                        return wakeable(slot) || io.load() != nullptr || batches.holding();
+                    });
                 }
             }
         }
@@ -322,17 +1036,20 @@ private:
 
     // recursive execute
     template <typename F>
-    void rexec(F&& func) {
+    static void rexec(F&& func) {
         func();
     }
 
     // recursive execute
     template <typename F, typename... Fs>
-    void rexec(F&& func, Fs&&... funcs) {
+    static void rexec(F&& func, Fs&&... funcs) {
         func();
         rexec(std::forward<Fs>(funcs)...);
     }
 };
 
+// workbranch with the default policies
+using workbranch = basic_workbranch<>;
+
 }  // namespace details
 }  // namespace wsp
\ No newline at end of file
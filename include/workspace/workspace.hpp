@@ -1,9 +1,13 @@
 #pragma once
 #include <cassert>
+#include <chrono>
 #include <list>
 #include <map>
 #include <memory>
 #include <vector>
+#include <workspace/channel.hpp>
+#include <workspace/limiter.hpp>
+#include <workspace/pipeline.hpp>
 #include <workspace/supervisor.hpp>
 #include <workspace/workbranch.hpp>
 
@@ -18,15 +22,85 @@ using urg = details::urgent;
 using nor = details::normal;
 // Can be executed by a thread at a time
 using seq = details::sequence;
+// Never throws, returns its future without try/catch
+using noexc = details::noexception;
 }  // namespace task
 
+// workbranch policies
+namespace policy {
+// task queue
+template <typename T>
+using taskqueue = details::taskqueue<T>;
+// task queue shared fairly by tenants (submit_as)
+template <typename T>
+using fairqueue = details::fairqueue<T>;
+// task queue ordered by deadline (submit_by)
+template <typename T>
+using edfqueue = details::edfqueue<T>;
+// runnable object
+using task_t = details::task_t;
+// choose waitstrategy at runtime (default)
+using dynamic = details::dynamic_wait;
+// busy-wait with std::this_thread::yield()
+using lowlatancy = details::lowlatancy_wait;
+// busy-wait initially, then sleep briefly
+using balance = details::balance_wait;
+// block until a task is available
+using blocking = details::blocking_wait;
+// catch and log exceptions thrown by tasks (default)
+using log_exceptions = details::log_exceptions;
+// no exception handling, an escaped exception terminates the program
+using ignore_exceptions = details::ignore_exceptions;
+}  // namespace policy
+
 // std::future collector
 template <typename RT>
 using futures = details::futures<RT>;
 // An async working node
 using workbranch = details::workbranch;
+// An async working node assembled from policies at compile time
+template <template <typename> class Queue = details::taskqueue, typename Wait = details::dynamic_wait,
+          typename Task = details::task_t, typename Exception = details::log_exceptions>
+using basic_workbranch = details::basic_workbranch<Queue, Wait, Task, Exception>;
+// workbranch whose tenants share the workers by weight (submit_as)
+using fair_workbranch = details::basic_workbranch<details::fairqueue>;
+// workbranch running the task with the earliest deadline first (submit_by)
+using edf_workbranch = details::basic_workbranch<details::edfqueue>;
+// how a workbranch creates its workers (lazily, stack size)
+using worker_options = details::worker_options;
+// bounded MPMC channel between tasks
+template <typename T>
+using channel = details::channel<T>;
+// linear pipeline of serial and parallel stages
+template <typename T>
+using pipeline = details::pipeline<T>;
+// token bucket and concurrency cap in front of a workbranch
+using limiter = details::limiter;
 // workbranch supervisor
 using supervisor = details::supervisor;
+// tag of a supervisor without a thread: wsp::supervisor sp(min, max, wsp::manual_tick)
+constexpr details::manual_tick_t manual_tick{};
+// a task found running too long by the supervisor
+using stall_info = details::stall_info;
+// counters of a workbranch
+using branch_snapshot = details::branch_snapshot;
+// counters of a tenant of a fair-share workbranch
+using tenant_stats = details::tenant_stats;
+// deadline counters of an EDF workbranch
+using deadline_stats = details::deadline_stats;
+// exception caught by a worker
+using error_info = details::error_info;
+// state owned by a worker (index, scratch arena, typed slots)
+using worker_context = details::worker_context;
+
+/**
+ * @brief get the context of the worker running current task
+ * @return reference of the context
+ * @note Throws std::runtime_error if called outside a worker.
+ */
+inline worker_context& this_worker() {
+    return details::this_worker();
+}
 
 }  // namespace wsp
 
@@ -177,6 +251,29 @@ public:
         }
     }
 
+    /**
+     * @brief wait until every workbranch has nothing to do, without pausing the workers
+     * @param deadline the latest time to return, shared by all workbranches
+     * @return ids of the workbranches still busy at the deadline (empty if all done)
+     * @note The whole call takes no longer than the deadline whatever the number of branches.
+     */
+    std::vector<bid> wait_all(std::chrono::steady_clock::time_point deadline) {
+        for (auto& each : branches) {
+            each->flush();
+        }
+        std::vector<bid> busy;
+        while (true) {
+            for (auto& each : branches) {
+                if (!each->wait_idle(deadline)) break;  // out of time, the rest is checked below
+            }
+            busy.clear();
+            for (auto& each : branches) {  // tasks may have submitted tasks to the branches done before
+                if (!each->is_idle()) busy.emplace_back(each.get());
+            }
+            if (busy.empty() || std::chrono::steady_clock::now() >= deadline) return busy;
+        }
+    }
+
     /**
      * @brief get ref of workbranch by id
      * @param id workbranch's id
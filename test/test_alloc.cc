@@ -0,0 +1,188 @@
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <new>
+#include <string>
+#include <vector>
+#include <workspace/workspace.hpp>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+// Counts the allocations made through the global operator new/delete (all threads).
+// Blocks from malloc itself are not seen, such as details::cache_aligned::operator new
+// and the scratch arena; the resident set size of the backlog checks they stay small.
+// Every block carries a header holding its size, so the bytes alive are known too.
+namespace counting {
+std::atomic<uint64_t> allocs{0};
+std::atomic<uint64_t> bytes{0};
+std::atomic<int64_t> live{0};
+constexpr size_t header = 16;  // keeps the alignment of malloc
+
+void* allocate(size_t n) {
+    auto p = static_cast<char*>(std::malloc(n + header));
+    if (!p) return nullptr;
+    *reinterpret_cast<size_t*>(p) = n;
+    allocs.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(n, std::memory_order_relaxed);
+    live.fetch_add(static_cast<int64_t>(n), std::memory_order_relaxed);
+    return p + header;
+}
+void release(void* ptr) {
+    if (!ptr) return;
+    auto p = static_cast<char*>(ptr) - header;
+    live.fetch_sub(static_cast<int64_t>(*reinterpret_cast<size_t*>(p)), std::memory_order_relaxed);
+    std::free(p);
+}
+}  // namespace counting
+
+void* operator new(size_t n) {
+    if (auto p = counting::allocate(n)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t n) {
+    if (auto p = counting::allocate(n)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(size_t n, const std::nothrow_t&) noexcept {
+    return counting::allocate(n);
+}
+void* operator new[](size_t n, const std::nothrow_t&) noexcept {
+    return counting::allocate(n);
+}
+void operator delete(void* p) noexcept {
+    counting::release(p);
+}
+void operator delete[](void* p) noexcept {
+    counting::release(p);
+}
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    counting::release(p);
+}
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    counting::release(p);
+}
+
+// resident set size (bytes), 0 if unknown
+size_t rss() {
+#if defined(__linux__)
+    long pages = 0, resident = 0;
+    if (FILE* f = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        std::fclose(f);
+    }
+    return static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+// task capturing N bytes
+template <size_t N>
+struct payload {
+    char data[N];
+    void operator()() const {
+    }
+};
+
+struct cost {
+    double allocs;  // per task
+    double bytes;   // per task
+};
+
+const int rounds = 10000;
+
+/**
+ * @brief allocations per task from submission to completion
+ * @param submit submits one task to br
+ * @note The cost of waiting for the branch is measured alone and taken off.
+ */
+template <typename Submit>
+cost measure(const char* name, wsp::workbranch& br, Submit&& submit) {
+    auto idle = [&] { br.wait_idle(std::chrono::steady_clock::now() + std::chrono::seconds(10)); };
+    for (int i = 0; i < rounds; ++i) submit();  // warm up the queue
+    idle();
+
+    auto a0 = counting::allocs.load(), b0 = counting::bytes.load();
+    idle();
+    auto wait_allocs = counting::allocs.load() - a0, wait_bytes = counting::bytes.load() - b0;
+
+    a0 = counting::allocs.load(), b0 = counting::bytes.load();
+    for (int i = 0; i < rounds; ++i) submit();
+    idle();
+    cost c;
+    c.allocs = double(counting::allocs.load() - a0 - wait_allocs) / rounds;
+    c.bytes = double(counting::bytes.load() - b0 - wait_bytes) / rounds;
+    std::printf("%-36s %8.3f allocs/task %9.1f bytes/task\n", name, c.allocs, c.bytes);
+    return c;
+}
+
+/**
+ * @brief memory held by a backlog of "n" queued tasks
+ * @param submit submits one task to br
+ * @return heap bytes held per queued task
+ */
+template <typename Submit>
+double backlog(const char* name, wsp::workbranch& br, size_t n, Submit&& submit) {
+    std::promise<void> gate;
+    auto opened = gate.get_future().share();
+    br.submit([opened] { opened.wait(); });  // the single worker holds the backlog
+    auto live0 = counting::live.load();
+    auto rss0 = rss();
+    for (size_t i = 0; i < n; ++i) submit();
+    auto held = counting::live.load() - live0;
+    auto rss1 = rss();
+    auto grown = rss1 > rss0 ? rss1 - rss0 : 0;
+    gate.set_value();
+    br.wait_idle(std::chrono::steady_clock::now() + std::chrono::seconds(10));
+    std::printf("%-36s %8.1f heap bytes/task %6.1f MB rss growth\n", name, double(held) / n, grown / 1048576.0);
+    // nothing uncounted grows with the backlog (slack for pages of the allocator)
+    assert(!rss0 || grown <= static_cast<size_t>(held) * 3 / 2 + (4 << 20));
+    return double(held) / n;
+}
+
+int main() {
+    std::printf("function_ inline size: %zu bytes, sizeof(task_t): %zu bytes\n", wsp::policy::task_t::inline_size,
+                sizeof(wsp::policy::task_t));
+
+    // cost of each submit overload and capture size
+    {
+        wsp::workbranch br(1);
+        auto nothing = [] {};
+        auto inline_8 = measure("submit(capture 8B)", br, [&] { br.submit(payload<8>()); });
+        auto inline_max = measure("submit(capture inline max)", br,
+                                  [&] { br.submit(payload<wsp::policy::task_t::inline_size>()); });
+        auto spilled = measure("submit(capture inline max + 8B)", br,
+                               [&] { br.submit(payload<wsp::policy::task_t::inline_size + 8>()); });
+        measure("submit(capture 256B)", br, [&] { br.submit(payload<256>()); });
+        auto urgent = measure("submit<task::urg>(capture 8B)", br, [&] { br.submit<wsp::task::urg>(payload<8>()); });
+        measure("submit<task::noexc>(capture 8B)", br, [&] { br.submit<wsp::task::noexc>(payload<8>()); });
+        measure("submit<task::seq>(2 empty tasks)", br, [&] { br.submit<wsp::task::seq>(nothing, nothing); });
+        auto raw = measure("submit_raw(fn, ctx)", br, [&] { br.submit_raw([](void*) {}, nullptr); });
+        auto future = measure("submit(returns int) + future", br, [&] { br.submit([] { return 1; }).get(); });
+        measure("submit<task::urg>(returns int)", br, [&] { br.submit<wsp::task::urg>([] { return 1; }).get(); });
+
+        // the paths meant to be allocation-free only pay for the growth of the queue (amortized)
+        assert(inline_8.allocs < 0.5 && inline_max.allocs < 0.5);
+        assert(urgent.allocs < 0.5 && raw.allocs < 0.5);
+        // a closure over the inline size spills to the heap once
+        assert(spilled.allocs >= 1 && spilled.allocs < 1.5);
+        // futures cost the shared state of the promise
+        assert(future.allocs >= 1);
+    }
+
+    // memory held by a large backlog
+    {
+        wsp::workbranch br(1);
+        const size_t n = 200000;
+        auto inlined = backlog("backlog of inline tasks", br, n, [&] { br.submit(payload<8>()); });
+        auto spilled = backlog("backlog of spilled tasks (256B)", br, n, [&] { br.submit(payload<256>()); });
+        auto raw = backlog("backlog of raw tasks", br, n, [&] { br.submit_raw([](void*) {}, nullptr); });
+        assert(raw < inlined && inlined < spilled);
+        assert(inlined < sizeof(wsp::policy::task_t) + 16);  // no per-task bookkeeping besides the task
+    }
+    std::cout << "alloc: ok" << std::endl;
+}
@@ -0,0 +1,113 @@
+#include <cassert>
+#include <future>
+#include <workspace/workspace.hpp>
+
+int main() {
+    // backpressure: a full channel refuses values
+    {
+        wsp::channel<int> ch(4);
+        for (int i = 0; i < 4; ++i) assert(ch.try_send(i));
+        assert(!ch.try_send(4));
+        int v = -1;
+        assert(ch.try_recv(v) && v == 0);
+        ch.close();
+        assert(!ch.try_send(5));
+        std::vector<int> rest;
+        assert(ch.try_recv(rest, 10) == 3);
+        assert(!ch.recv(v));  // end of stream
+    }
+
+    // a consumer task is scheduled onto the branch when values arrive
+    {
+        wsp::workbranch br(2);
+        wsp::channel<int> ch(64);
+        long sum = 0;
+        int expect = 0;
+        bool ordered = true;
+        std::promise<void> eos;
+        ch.subscribe(
+            br,
+            [&](std::vector<int>& items) {
+                for (int v : items) {
+                    ordered = ordered && v == expect++;
+                    sum += v;
+                }
+            },
+            [&] { eos.set_value(); });
+
+        std::thread producer([ch]() mutable {
+            for (int i = 0; i < 10000; ++i) ch.send(i);  // waits while the channel is full
+            ch.close();
+        });
+        eos.get_future().wait();
+        producer.join();
+        std::cout << "received: " << expect << " | sum: " << sum << std::endl;
+        assert(ordered && expect == 10000 && sum == 49995000L);
+    }
+
+    // streaming between two branches without per-item closures
+    {
+        wsp::workbranch stage1(2), stage2(1);
+        wsp::channel<std::string> ch(16);
+        std::atomic<int> got{0};
+        std::promise<void> eos;
+        ch.subscribe(stage2, [&](std::vector<std::string>& items) { got += static_cast<int>(items.size()); },
+                     [&] { eos.set_value(); });
+        for (int i = 0; i < 100; ++i) {
+            stage1.submit([ch, i]() mutable {
+                while (!ch.try_send(std::to_string(i))) std::this_thread::yield();
+            });
+        }
+        stage1.wait_tasks();
+        ch.close();
+        eos.get_future().wait();
+        assert(got == 100);
+    }
+
+    // senders racing close(): every value accepted is received before the end of stream
+    {
+        wsp::workbranch br(2);
+        for (int round = 0; round < 200; ++round) {
+            wsp::channel<int> ch(64);
+            std::atomic<int> got{0};
+            std::promise<int> eos;
+            ch.subscribe(br, [&](std::vector<int>& items) { got += static_cast<int>(items.size()); },
+                         [&] { eos.set_value(got.load()); });
+            std::atomic<int> sent{0};
+            std::vector<std::thread> senders;
+            for (int t = 0; t < 3; ++t) {
+                senders.emplace_back([ch, &sent, t]() mutable {
+                    std::vector<int> pair = {1, 2};
+                    for (int i = 0; i < 1000; ++i) {
+                        int n = t == 0 ? ch.send(i) : t == 1 ? ch.try_send(i) : ch.try_send(pair.begin(), pair.end());
+                        sent += n;
+                        if (!n && ch.closed()) return;
+                    }
+                });
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(round % 20 * 10));
+            ch.close();
+            for (auto& each : senders) each.join();
+            assert(eos.get_future().get() == sent.load());
+        }
+
+        // the same for a receiving thread
+        for (int round = 0; round < 200; ++round) {
+            wsp::channel<int> ch(64);
+            std::atomic<int> sent{0};
+            std::thread sender([ch, &sent]() mutable {
+                for (int i = 0; ch.send(i); ++i) sent++;
+            });
+            int got = 0, v = 0;
+            std::thread receiver([ch, &got, &v]() mutable {
+                while (ch.recv(v)) got++;
+            });
+            std::this_thread::sleep_for(std::chrono::microseconds(round % 20 * 10));
+            ch.close();
+            sender.join();
+            receiver.join();
+            assert(got == sent.load());
+        }
+    }
+    std::cout << "channel ok" << std::endl;
+}
@@ -1,3 +1,5 @@
+#include <atomic>
+#include <cassert>
 #include <workspace/workspace.hpp>
 
 // self-defined exception machenism
@@ -41,4 +43,37 @@ int main() {
     } catch (std::exception& e) {
         std::cerr << "Caught error: " << e.what() << std::endl;
     }
-}
\ No newline at end of file
+
+    wbr.wait_tasks();
+    assert(wbr.errors().count() == 3);  // exceptions in futures are not reported
+    assert(wbr.errors().drain([](const wsp::error_info&) {}) == 3);  // all kept for drain()
+
+    // custom error handler
+    std::atomic<int> caught(0);
+    wsp::workbranch wbr2;
+    wbr2.set_error_handler([&caught](const wsp::error_info& info) {
+        caught++;
+        std::cerr << "handler: " << info.type << " " << info.what << std::endl;
+    });
+    wbr2.submit([] { throw std::logic_error("A logic error"); });
+    wbr2.submit([] { throw 1; });
+
+    // noexcept task is never wrapped
+    auto future3 = wbr2.submit<wsp::task::noexc>([]() noexcept { return 3; });
+    wbr2.submit<wsp::task::noexc>([]() noexcept {});
+    assert(future3.get() == 3);
+    wbr2.wait_tasks();
+    assert(caught == 2);
+
+    // a noexc value task that throws anyway: caught by the worker, the future is broken at once
+    auto future4 = wbr2.submit<wsp::task::noexc>([]() -> int { throw std::runtime_error("not noexcept"); });
+    assert(future4.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    try {
+        future4.get();
+        assert(false);
+    } catch (const std::future_error& e) {
+        assert(e.code() == std::future_errc::broken_promise);
+    }
+    wbr2.wait_tasks();
+    assert(caught == 3);
+}
@@ -65,6 +65,7 @@ int main() {
         seperate();
         task_t a;
         cout<<"sizeof(task_t a) = " << sizeof(a) << endl;
+        assert(sizeof(a) < 64);
         assert(!a);
         task_t b = a;
         assert(!b);
@@ -98,6 +99,22 @@ int main() {
         assert(!b);
         assert(c);
     } 
+    // Function pointer and empty lambda (memcpy-ed)
+    {
+        seperate();
+        static int count = 0;
+        struct counter {
+            static void incr() { count++; }
+        };
+        task_t a{&counter::incr};
+        task_t b{[] { count++; }};
+        task_t c = std::move(a);
+        task_t d = b;
+        c();
+        d();
+        b();
+        assert(!a && count == 3);
+    }
     // check
     {
         seperate();
@@ -0,0 +1,59 @@
+#include <cassert>
+#include <chrono>
+#include <workspace/workspace.hpp>
+
+int main() {
+    // concurrency cap: held tasks occupy no worker
+    {
+        wsp::workbranch br(4);
+        std::atomic<int> running{0}, peak{0}, others{0};
+        {
+            wsp::limiter disk(br, 0, 1, 2);  // no rate limit, 2 at a time
+            for (int i = 0; i < 20; ++i) {
+                disk.submit([&] {
+                    int now = ++running;
+                    int old = peak.load();
+                    while (now > old && !peak.compare_exchange_weak(old, now)) {
+                    }
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    running--;
+                });
+            }
+            assert(disk.num_held() > 0 && disk.num_delayed() > 0);
+            for (int i = 0; i < 100; ++i) br.submit([&] { others++; });  // not blocked by the held tasks
+            br.wait_tasks();
+            assert(others == 100);
+        }  // waits for the held tasks
+        std::cout << "peak concurrency: " << peak.load() << std::endl;
+        assert(peak.load() <= 2);
+    }
+
+    // token bucket: 200 tasks/s with a burst of 10
+    {
+        wsp::workbranch br(2);
+        std::atomic<int> count{0};
+        auto begin = std::chrono::steady_clock::now();
+        {
+            wsp::limiter db(br, 200, 10);
+            for (int i = 0; i < 50; ++i) db.submit([&] { count++; });
+        }
+        auto cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+        std::cout << "50 tasks at 200/s (burst 10): " << cost.count() << " ms" << std::endl;
+        assert(count == 50);
+        assert(cost.count() >= 150);  // 40 tasks after the burst need 200ms
+    }
+
+    // an exception thrown by a task releases its slot
+    {
+        wsp::workbranch br(1);
+        wsp::limiter one(br, 0, 1, 1);
+        std::atomic<int> count{0};
+        one.submit([] { throw std::runtime_error("limited task failed"); });
+        one.submit([&] { count++; });
+        for (int i = 0; i < 1000 && (count != 1 || one.num_running()); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        assert(count == 1 && one.num_running() == 0);
+    }
+    std::cout << "limiter: ok" << std::endl;
+}
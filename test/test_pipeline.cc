@@ -0,0 +1,67 @@
+#include <cassert>
+#include <workspace/workspace.hpp>
+
+struct item {
+    int id = 0;
+    long value = 0;
+};
+
+int main() {
+    wsp::workbranch io(2), cpu(4);
+
+    // serial stages see the items in input order, parallel stages overlap
+    {
+        const int total = 1000;
+        const size_t tokens = 8;
+        std::atomic<int> in_flight{0}, peak{0};
+        int parsed = 0, written = 0;
+        long sum = 0;
+        bool ordered = true;
+
+        wsp::pipeline<item> pl(tokens);
+        pl.serial(io, [&](item& it) { ordered = ordered && it.id == parsed++; })  // parse
+            .parallel(cpu, [](item& it) { it.value = long(it.id) * it.id; })      // transform
+            .serial(io, [&](item& it) {                                           // write
+                ordered = ordered && it.id == written++;
+                sum += it.value;
+                in_flight--;
+            });
+
+        int next = 0;
+        auto done = pl.run(io, [&](item& it) {
+            if (next == total) return false;
+            it.id = next++;
+            int now = ++in_flight;
+            int old = peak.load();
+            while (now > old && !peak.compare_exchange_weak(old, now)) {
+            }
+            return true;
+        });
+        size_t n = done.get();
+        std::cout << "items: " << n << " | peak in flight: " << peak << std::endl;
+        assert(n == total && ordered && written == total);
+        assert(sum == long(total - 1) * total * (2 * total - 1) / 6);
+        assert(peak <= int(tokens));
+    }
+
+    // the first exception stops the input and reaches the future
+    {
+        wsp::pipeline<item> pl(4);
+        pl.parallel(cpu, [](item& it) {
+            if (it.id == 10) throw std::runtime_error("bad item");
+        });
+        int next = 0;
+        auto done = pl.run(io, [&](item& it) {
+            it.id = next++;
+            return true;  // endless input
+        });
+        bool thrown = false;
+        try {
+            done.get();
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+    std::cout << "pipeline ok" << std::endl;
+}
@@ -0,0 +1,90 @@
+#include <cassert>
+#include <chrono>
+#include <future>
+#include <workspace/workspace.hpp>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+int main() {
+    // the handler runs on a worker whenever the pipe is readable
+    {
+        wsp::workbranch br(2, wsp::waitstrategy::blocking);
+        int fds[2];
+        assert(pipe(fds) == 0);
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        std::atomic<int> bytes{0};
+        std::atomic<bool> overlapped{false};
+        std::atomic<int> running{0};
+        br.watch(fds[0], EPOLLIN, [&](int fd, uint32_t) {
+            if (running.fetch_add(1)) overlapped = true;  // never concurrent with itself
+            char buf[64];
+            ssize_t n;
+            while ((n = read(fd, buf, sizeof(buf))) > 0) bytes += static_cast<int>(n);
+            running.fetch_sub(1);
+        });
+        for (int i = 0; i < 100; ++i) {
+            assert(write(fds[1], "abcd", 4) == 4);
+            if (i % 10 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        auto until = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (bytes.load() < 400 && std::chrono::steady_clock::now() < until) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::cout << "bytes read: " << bytes.load() << std::endl;
+        assert(bytes.load() == 400 && !overlapped);
+
+        br.unwatch(fds[0]);
+        assert(write(fds[1], "x", 1) == 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        assert(bytes.load() == 400);
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    // a submission interrupts the worker blocking in epoll_wait()
+    {
+        wsp::workbranch br(1, wsp::waitstrategy::blocking);
+        int fds[2];
+        assert(pipe(fds) == 0);
+        br.watch(fds[0], EPOLLIN, [](int, uint32_t) {});
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));  // the worker is polling
+        auto begin = std::chrono::steady_clock::now();
+        std::promise<void> done;
+        br.submit([&] { done.set_value(); });
+        auto fut = done.get_future();
+        assert(fut.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+        auto cost = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin);
+        std::cout << "woken in: " << cost.count() << " us" << std::endl;
+        br.unwatch(fds[0]);
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    // workers still run tasks and leave normally with a reactor
+    {
+        wsp::workbranch br(4, wsp::waitstrategy::balance);
+        int fds[2];
+        assert(pipe(fds) == 0);
+        br.watch(fds[0], EPOLLIN, [](int, uint32_t) {});
+        std::atomic<int> count{0};
+        for (int i = 0; i < 10000; ++i) br.submit([&] { count++; });
+        br.wait_tasks();
+        assert(count == 10000);
+        br.del_worker();
+        br.del_worker();
+        br.wait_tasks();
+        assert(br.num_workers() == 2);
+        br.unwatch(fds[0]);
+        close(fds[0]);
+        close(fds[1]);
+    }
+    std::cout << "reactor: ok" << std::endl;
+}
+#else
+int main() {
+    std::cout << "reactor: skipped (Linux only)" << std::endl;
+}
+#endif
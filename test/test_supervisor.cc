@@ -1,3 +1,4 @@
+#include <future>
 #include <workspace/workspace.hpp>
 
 template <typename F>
@@ -15,7 +16,7 @@ int main() {
     auto sp1 = space.attach(new wsp::supervisor(2, 4));
 
     // init
-    int count = 0;
+    std::atomic<int> count{0};
     space[sp1].set_tick_cb([&count] { count++; });  // same callback for each workbranch
 
     // start supervising
@@ -46,4 +47,181 @@ int main() {
     space[sp1].proceed();  // go on
 
     std::this_thread::sleep_for(std::chrono::seconds(3));  // take a rest
-}
\ No newline at end of file
+
+    // share a thread budget between workbranches
+    {
+        wsp::workbranch wbr1, wbr2, wbr3;
+        wsp::supervisor spv(1, 8, 50);
+        spv.set_budget(6);
+        spv.supervise(wbr1);
+        spv.supervise(wbr2);
+        spv.supervise(wbr3, 2.0, 2);  // double weight and 2 workers guaranteed
+
+        size_t peak = 0;
+        spv.set_tick_cb([&](const std::vector<wsp::branch_snapshot>& snaps) {
+            size_t total = 0;
+            for (auto& each : snaps) total += each.workers;
+            peak = std::max(peak, total);
+            assert(total <= 6);
+        });
+        repeat([&] {
+            wbr1.submit(sleep_task);
+            wbr2.submit(sleep_task);
+            wbr3.submit(sleep_task);
+        }, 30);
+        wbr1.wait_tasks();
+        wbr2.wait_tasks();
+        wbr3.wait_tasks();
+        spv.suspend();
+        std::cout << "budget: 6 | peak workers: " << peak << std::endl;
+    }
+
+    // a stuck task is reported and a worker is added for it
+    {
+        wsp::workbranch wbr(1);
+        wsp::supervisor spv(1, 2, 20);
+        std::promise<wsp::stall_info> reported;
+        std::atomic<bool> once{false};
+        spv.set_stall_detector(
+            100,
+            [&](const wsp::stall_info& info) {
+                if (!once.exchange(true)) reported.set_value(info);
+            },
+            true);
+        spv.supervise(wbr);
+
+        std::promise<void> unstick;
+        auto stuck = unstick.get_future().share();
+        wbr.submit([stuck] { stuck.wait(); });
+        auto fut = reported.get_future();
+        assert(fut.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+        auto info = fut.get();
+        std::cout << "stalled: worker " << info.worker << " task " << info.task << " after " << info.running_ms
+                  << " ms" << std::endl;
+        assert(info.branch == 0 && info.running_ms >= 100 && info.compensated);
+        assert(wbr.submit([] { return 1; }).get() == 1);  // run by the added worker
+        unstick.set_value();
+        wbr.wait_tasks();
+        spv.suspend();
+    }
+
+    // sleeping tasks are not CPU-bound: more workers would not be added for them
+    {
+        wsp::workbranch wbr(1);
+        wsp::supervisor spv(1, 4, 20);
+        spv.set_cpu_limits(0, 0.5);
+        auto nap = [] { std::this_thread::sleep_for(std::chrono::milliseconds(5)); };
+        repeat([&] { wbr.submit(nap); }, 60);
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));  // the first samples
+        spv.supervise(wbr);
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        auto snap = wbr.snapshot();
+        std::cout << "blocking-bound: workers " << snap.workers << " | busy cpu " << snap.busy_cpu_ns / 1000
+                  << " us of " << snap.busy_sampled_ns / 1000 << " us" << std::endl;
+        assert(snap.workers == 1 && snap.busy_cpu_ns < snap.busy_sampled_ns / 2);
+        spv.set_cpu_limits(0);  // no limit: grows again
+        wbr.wait_tasks();
+        spv.suspend();
+    }
+
+    // without a thread the supervisor checks only when ticked
+    {
+        wsp::workbranch wbr(1);
+        wsp::supervisor spv(1, 4, wsp::manual_tick);
+        size_t ticks = 0;
+        spv.set_tick_cb([&] { ticks++; });
+        spv.supervise(wbr);
+        std::promise<void> gate;
+        auto opened = gate.get_future().share();
+        repeat([&] { wbr.submit([opened] { opened.wait(); }); }, 8);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        assert(ticks == 0 && wbr.num_workers() == 1);
+        spv.tick();
+        assert(ticks == 1 && wbr.num_workers() == 4);
+        gate.set_value();
+        wbr.wait_tasks();
+        spv.tick();
+        auto until = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (wbr.num_workers() != 3 && std::chrono::steady_clock::now() < until) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        assert(ticks == 2 && wbr.num_workers() == 3);  // slow dec
+    }
+
+    // stall detection on a virtual clock
+    {
+        wsp::workbranch wbr(1);
+        wsp::supervisor spv(1, 4, wsp::manual_tick);
+        std::vector<wsp::stall_info> found;
+        spv.set_stall_detector(1000, [&](const wsp::stall_info& info) { found.push_back(info); });
+        spv.supervise(wbr);
+        std::promise<void> started, gate;
+        auto opened = gate.get_future().share();
+        wbr.submit([&started, opened] {
+            started.set_value();
+            opened.wait();
+        });
+        started.get_future().wait();
+        const uint64_t ms = 1000000;
+        spv.tick(0 * ms);
+        spv.tick(900 * ms);
+        assert(found.empty());
+        spv.tick(1500 * ms);  // at once, no real second has passed
+        assert(found.size() == 1 && found[0].running_ms == 1500);
+        gate.set_value();
+        wbr.wait_tasks();
+    }
+
+    // workers asked to leave while busy are not deleted again on every tick
+    {
+        wsp::workbranch wbr(4);
+        wsp::supervisor spv(1, 4, wsp::manual_tick);
+        spv.supervise(wbr);
+        std::atomic<int> started{0};
+        std::promise<void> gate;
+        auto opened = gate.get_future().share();
+        auto hold = [&started, opened] {
+            started++;
+            opened.wait();
+        };
+        repeat([&] { wbr.submit(hold); }, 4);
+        while (started != 4) std::this_thread::yield();
+        repeat([&] { spv.tick(); }, 10);
+        assert(wbr.snapshot().declining == 3);  // down to the floor, once
+        gate.set_value();
+        auto until = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (wbr.num_workers() != 1 && std::chrono::steady_clock::now() < until) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        spv.tick();
+        assert(wbr.num_workers() == 1 && wbr.snapshot().declining == 0);
+    }
+
+    // stalled workers count against the budget, no replacement without room
+    {
+        wsp::workbranch wbr(2);
+        wsp::supervisor spv(1, 8, wsp::manual_tick);
+        spv.set_budget(2);
+        std::vector<wsp::stall_info> found;
+        spv.set_stall_detector(1000, [&](const wsp::stall_info& info) { found.push_back(info); }, true);
+        spv.supervise(wbr);
+        std::atomic<int> started{0};
+        std::promise<void> gate;
+        auto opened = gate.get_future().share();
+        auto hold = [&started, opened] {
+            started++;
+            opened.wait();
+        };
+        repeat([&] { wbr.submit(hold); }, 2);
+        while (started != 2) std::this_thread::yield();
+        wbr.submit([] {});  // backlog asking for more workers
+        const uint64_t ms = 1000000;
+        spv.tick(0 * ms);
+        spv.tick(2000 * ms);
+        spv.tick(3000 * ms);
+        assert(found.size() == 2 && !found[0].compensated && !found[1].compensated);
+        assert(wbr.num_workers() == 2);
+        gate.set_value();
+        wbr.wait_tasks();
+    }
+}
@@ -0,0 +1,51 @@
+#include <cassert>
+#include <sstream>
+#include <workspace/workspace.hpp>
+
+int main() {
+    wsp::workbranch br(2);
+
+    // trace every task
+    for (int i = 0; i < 1000; ++i) {
+        br.submit([] { std::this_thread::sleep_for(std::chrono::microseconds(10)); });
+    }
+    br.wait_tasks();
+    assert(br.run_histogram().count() == 1000);
+    assert(br.wait_histogram().count() == 1000);
+
+    // trace one of every 10 tasks
+    br.set_trace_sampling(10);
+    for (int i = 0; i < 1000; ++i) {
+        br.submit([] {});
+    }
+    br.wait_tasks();
+    auto run = br.run_histogram();
+    auto wait = br.wait_histogram();
+    assert(run.count() == 1100);
+    std::cout << "run  (ns): p50 " << run.percentile(50) << " | p99 " << run.percentile(99) << " | max "
+              << run.max() << std::endl;
+    std::cout << "wait (ns): p50 " << wait.percentile(50) << " | p99 " << wait.percentile(99) << " | max "
+              << wait.max() << std::endl;
+
+    // export in Chrome trace format
+    std::ostringstream oss;
+    br.export_trace(oss);
+    auto json = oss.str();
+    assert(json.find("{\"traceEvents\":[") == 0);
+    assert(json.find("\"ph\":\"X\"") != std::string::npos);
+    std::cout << "trace exported: " << json.size() << " bytes" << std::endl;
+
+    // the sampling rate holds per workbranch when one producer feeds several
+    {
+        wsp::workbranch a(1), b(1);
+        a.set_trace_sampling(2);
+        b.set_trace_sampling(2);
+        for (int i = 0; i < 100; ++i) {
+            a.submit([] {});
+            b.submit([] {});
+        }
+        a.wait_tasks();
+        b.wait_tasks();
+        assert(a.run_histogram().count() == 50 && b.run_histogram().count() == 50);
+    }
+}
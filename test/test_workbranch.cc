@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cassert>
+#include <set>
 #include <workspace/workspace.hpp>
 
 int main() {
@@ -28,5 +31,248 @@ int main() {
     // wait for tasks done
     br.wait_tasks();
 
+    // counters (lock-free)
+    wsp::branch_snapshot snap = br.snapshot();
+    std::cout << "submitted: " << snap.submitted << " | executed: " << snap.executed
+              << " | urgent: " << snap.urgent << " | busy: " << snap.busy_ns << " (ns)" << std::endl;
+    assert(snap.submitted == 4 && snap.urgent == 1 && snap.executed == 4 && snap.tasks == 0);
+
+    // raw task: a free function with its context (16 bytes in the task queue)
+    {
+        wsp::workbranch one;
+        std::vector<int> order;
+        struct step {
+            static void run(void* ctx) { static_cast<std::vector<int>*>(ctx)->push_back(1); }
+        };
+        one.submit([&] { order.push_back(0); });
+        one.submit_raw(&step::run, &order);
+        one.submit([&] { order.push_back(2); });
+        one.wait_tasks();
+        assert((order == std::vector<int>{0, 1, 2}));
+
+        // both kinds keep their order at both ends of the queue
+        wsp::details::taskqueue<wsp::policy::task_t> q;
+        auto add = [&](int v) { return wsp::policy::task_t([&order, v] { order.push_back(v); }); };
+        order.clear();
+        q.push_back(add(2));
+        q.push_back(wsp::details::raw_task{&step::run, &order});
+        q.push_back(wsp::details::raw_task{&step::run, &order});
+        q.push_front(wsp::details::raw_task{&step::run, &order});
+        q.push_front(add(0));
+        q.push_back(add(3));
+        assert(q.length() == 6);
+        wsp::policy::task_t task;
+        while (q.try_pop(task)) task();
+        assert((order == std::vector<int>{0, 1, 2, 1, 1, 3}) && q.length() == 0);
+    }
+
+    // run on every worker, or on one worker
+    {
+        wsp::workbranch three(3);
+        std::mutex mtx;
+        std::set<std::thread::id> ids;
+        auto done = three.broadcast([&] {
+            std::lock_guard<std::mutex> lock(mtx);
+            ids.insert(std::this_thread::get_id());
+        });
+        done.wait();
+        assert(ids.size() == 3);
+
+        std::thread::id first, second;
+        three.submit_to(1, [&] { first = std::this_thread::get_id(); });
+        three.submit_to(1, [&] { second = std::this_thread::get_id(); });
+        three.wait_tasks();
+        assert(first == second && ids.count(first));
+    }
+
+    // per-worker context: index, scratch arena and typed slots
+    {
+        wsp::workbranch two(2);
+        struct counter {
+            int n = 0;
+        };
+        std::atomic<int> bad{0};
+        for (int i = 0; i < 100; ++i) {
+            two.submit([&] {
+                auto& ctx = wsp::this_worker();
+                if (ctx.index() >= 2) bad++;
+                auto buf = ctx.arena().allocate_array<char>(1000);
+                buf[999] = 1;
+                ctx.local<counter>().n++;
+            });
+        }
+        two.wait_tasks();
+        std::atomic<int> total{0};
+        two.broadcast([&] { total += wsp::this_worker().local<counter>().n; }).wait();
+        assert(bad == 0 && total == 100);
+
+        bool thrown = false;
+        try {
+            wsp::this_worker();
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+
+        // the objects of a leaving worker are destroyed outside the lock of the branch
+        struct peeker {
+            wsp::workbranch* br = nullptr;
+            std::promise<void>* gone = nullptr;
+            ~peeker() {
+                if (!br) return;
+                br->wait_idle(std::chrono::steady_clock::now());  // takes the lock
+                gone->set_value();
+            }
+        };
+        std::promise<void> gone;
+        two.submit_to(1, [&] {
+            auto& p = wsp::this_worker().local<peeker>();
+            p.br = &two;
+            p.gone = &gone;
+        });
+        two.wait_tasks();
+        two.del_worker();
+        two.del_worker();
+        assert(gone.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    }
+
+    // runtime-sized sequence
+    {
+        wsp::workbranch two(2);
+        std::vector<int> order;
+        std::vector<std::function<void()>> steps;
+        for (int i = 0; i < 5; ++i) steps.emplace_back([&order, i] { order.push_back(i); });
+        two.submit_seq(steps);
+        two.wait_tasks();
+        assert((order == std::vector<int>{0, 1, 2, 3, 4}));
+    }
+
+    // coalescing: tiny tasks of one producer are published in batches
+    {
+        wsp::workbranch two(2);
+        two.set_coalescing(16, 1000);
+        std::atomic<int> count{0};
+        for (int i = 0; i < 100; ++i) two.submit([&] { count++; });
+        two.wait_tasks();
+        assert(count == 100);
+        assert(two.snapshot().submitted < 100);
+
+        two.submit([&] { count++; });  // published by an idle worker after the window
+        for (int i = 0; i < 1000 && count != 101; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        assert(count == 101);
+    }
+
+    // short-lived producers hand their batches over instead of adding new ones
+    {
+        wsp::details::coalescer<int> batches;
+        batches.configure(16, 1000000);
+        size_t published = 0;
+        auto publish = [&published](std::vector<int>&& tasks) { published += tasks.size(); };
+        for (int i = 0; i < 50; ++i) std::thread([&] { batches.add(int(i), publish); }).join();
+        assert(batches.size() == 1);
+        batches.flush(publish);
+        assert(published == 50);
+    }
+
+    // coalescing on blocking workers: a lone task is published when the window ends
+    {
+        wsp::workbranch parked(2, wsp::waitstrategy::blocking);
+        parked.set_coalescing(16, 20000);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));  // let the workers park
+        std::promise<uint64_t> ran;
+        auto begin = wsp::details::now_ns();
+        parked.submit([&] { ran.set_value(wsp::details::now_ns()); });
+        auto done = ran.get_future();
+        assert(done.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+        auto waited = done.get() - begin;
+        assert(waited >= 20000000 && waited < 1000000000);  // the window of 20ms, plus some slack
+    }
+
+    // fair share: a flooding tenant does not starve the others
+    {
+        wsp::fair_workbranch fair(1);
+        fair.set_tenant(1, 1);
+        fair.set_tenant(2, 2);
+        fair.set_tenant(3, 1, 2);
+        std::promise<void> started, gate;
+        auto opened = gate.get_future().share();
+        fair.submit([&started, opened] {
+            started.set_value();
+            opened.wait();
+        });
+        started.get_future().wait();
+        std::vector<int> order;
+        for (int i = 0; i < 100; ++i) assert(fair.submit_as(1, [&order] { order.push_back(1); }));
+        for (int i = 0; i < 10; ++i) assert(fair.submit_as(2, [&order] { order.push_back(2); }));
+        assert(fair.submit_as(3, [] {}) && fair.submit_as(3, [] {}));
+        assert(!fair.submit_as(3, [] {}));  // over max_depth
+        gate.set_value();
+        fair.wait_tasks();
+        assert(order.size() == 110);
+        assert(std::count(order.begin(), order.begin() + 15, 2) == 10);  // 2 of every 3 tasks
+        auto t3 = fair.tenant_snapshot(3);
+        assert(t3.submitted == 2 && t3.executed == 2 && t3.rejected == 1 && t3.depth == 0);
+        assert(fair.tenant_snapshot(1).executed == 100);
+    }
+
+    // earliest deadline first, expired tasks counted or dropped
+    {
+        wsp::edf_workbranch edf(1);
+        std::promise<void> started, gate;
+        auto opened = gate.get_future().share();
+        edf.submit([&started, opened] {
+            started.set_value();
+            opened.wait();
+        });
+        started.get_future().wait();
+        auto now = std::chrono::steady_clock::now();
+        std::vector<int> order;
+        for (int i = 5; i > 0; --i) {
+            edf.submit_by(now + std::chrono::seconds(i), [&order, i] { order.push_back(i); });
+        }
+        edf.submit_by(now - std::chrono::seconds(1), [&order] { order.push_back(0); });  // late
+        edf.submit<wsp::task::urg>([&order] { order.push_back(-1); });
+        edf.submit<wsp::task::urg>([&order] { order.push_back(-2); });  // urgent: the latest first
+        gate.set_value();
+        edf.wait_tasks();
+        assert((order == std::vector<int>{-2, -1, 0, 1, 2, 3, 4, 5}));
+        assert(edf.deadline_snapshot().misses == 1);
+
+        edf.set_drop_expired(true);
+        bool ran = false;
+        edf.submit_by(now - std::chrono::seconds(1), [&ran] { ran = true; });
+        edf.wait_tasks();
+        assert(!ran && edf.deadline_snapshot().dropped == 1);
+    }
+
+    // lazy workers with small stacks, spawned on demand or by prewarm()
+    {
+        wsp::worker_options opts;
+        opts.lazy = true;
+        opts.stack_size = 256 * 1024;
+        wsp::workbranch lazy(4, wsp::waitstrategy::blocking, opts);
+        assert(lazy.num_workers() == 0);
+        auto res = lazy.submit([] { return 1; });
+        assert(res.get() == 1 && lazy.num_workers() >= 1);
+        lazy.prewarm(16);  // only the workers not spawned yet
+        lazy.wait_tasks();
+        assert(lazy.num_workers() == 4);
+
+        wsp::workbranch eager(1);
+        eager.prewarm(16);
+        assert(eager.num_workers() == 17);
+    }
+
+    // policies chosen at compile time, no runtime dispatch in the worker loop
+    wsp::basic_workbranch<wsp::policy::taskqueue, wsp::policy::blocking, wsp::policy::task_t,
+                          wsp::policy::ignore_exceptions>
+        fast(2);
+    fast.submit([] { std::cout << "<blocking>" << std::endl; });
+    auto res = fast.submit([] { return 2023; });
+    assert(res.get() == 2023);
+    fast.del_worker();
+    fast.wait_tasks();
+    assert(fast.num_workers() == 1);
+
     // distruct -> close the threadpool
 }
@@ -1,3 +1,5 @@
+#include <cassert>
+#include <future>
 #include <iostream>
 #include <workspace/workspace.hpp>
 #define TID() std::this_thread::get_id()
@@ -32,4 +34,29 @@ int main() {
 
     // wait for tasks done
     space.for_each([](wsp::workbranch& each) { each.wait_tasks(); });
+
+    // one deadline for all workbranches, workers keep running
+    {
+        wsp::workspace spc;
+        auto fast = spc.attach(new wsp::workbranch(2));
+        auto slow = spc.attach(new wsp::workbranch(1));
+        std::atomic<int> count{0};
+        for (int i = 0; i < 1000; ++i) spc[fast].submit([&count] { count++; });
+        spc[fast].submit([&spc, slow, &count] { spc[slow].submit([&count] { count++; }); });  // nested
+        auto begin = std::chrono::steady_clock::now();
+        auto busy = spc.wait_all(begin + std::chrono::seconds(5));
+        assert(busy.empty() && count == 1001);
+
+        std::promise<void> release;
+        auto gate = release.get_future().share();
+        spc[slow].submit([gate] { gate.wait(); });
+        begin = std::chrono::steady_clock::now();
+        busy = spc.wait_all(begin + std::chrono::milliseconds(100));
+        auto cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+        std::cout << "wait_all: " << busy.size() << " busy after " << cost.count() << " ms" << std::endl;
+        assert(busy.size() == 1 && busy[0] == slow && cost.count() < 1000);
+        assert(spc[fast].submit([] { return 1; }).get() == 1);  // not paused
+        release.set_value();
+        assert(spc.wait_all(std::chrono::steady_clock::now() + std::chrono::seconds(5)).empty());
+    }
 }
\ No newline at end of file